@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+iterations="${1:-50}"
+
+flags=(
+    -fno-exceptions
+    -fno-rtti
+    -fshort-enums
+    "-march=native"
+    -O3
+    -pthread
+    "-std=c++11"
+)
+
+mkdir -p "$WD/bin" "$WD/bench"
+mold -run clang++ "${flags[@]}" -o "$WD/bin/bench" "$WD/src/main.cpp"
+
+shapes=(
+    "default"
+    "small --insts 1024"
+    "labels --label-density 0.5"
+    "vars --vars 8192"
+    "comments --comment-ratio 4"
+    "wide --line-length 160"
+)
+
+results=()
+for shape in "${shapes[@]}"; do
+    read -r name args <<< "$shape"
+    # shellcheck disable=SC2086
+    python3 "$WD/scripts/generate.py" "$WD/bench/$name.asm" $args
+    : > "$WD/bench/$name.jsonl"
+    for _ in $(seq "$iterations"); do
+        "$WD/bin/bench" --jobs 1 --stats json "$WD/bench/$name.asm" \
+            "$WD/bench/$name.hack" 2> /dev/null >> "$WD/bench/$name.jsonl"
+    done
+    results+=("$WD/bench/$name.jsonl")
+done
+
+python3 "$WD/scripts/summarize.py" "${results[@]}"
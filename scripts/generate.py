@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+
+from argparse import ArgumentParser
+from random import Random
+
+MAX_INSTS = 32767
+
+COMPS = [
+    "0", "1", "-1", "D", "A", "M", "!D", "!A", "!M", "-D", "-A", "-M",
+    "D+1", "A+1", "M+1", "D-1", "A-1", "M-1", "D+A", "D+M", "D-A", "D-M",
+    "A-D", "M-D", "D&A", "D&M", "D|A", "D|M",
+]
+DESTS = ["M", "D", "MD", "A", "AM", "AD", "AMD"]
+JUMPS = ["JGT", "JEQ", "JGE", "JLT", "JNE", "JLE", "JMP"]
+PREDEFS = [f"R{i}" for i in range(16)] + \
+    ["SP", "LCL", "ARG", "THIS", "THAT", "SCREEN", "KBD"]
+
+
+def get_inst(random, labels, variables):
+    if random.random() < 0.5:
+        x = random.random()
+        if x < 0.3:
+            return f"@{random.randrange(MAX_INSTS + 1)}"
+        if x < 0.45:
+            return f"@{random.choice(PREDEFS)}"
+        if (x < 0.75) and variables:
+            return f"@{random.choice(variables)}"
+        if labels:
+            return f"@{random.choice(labels)}"
+        return "@0"
+    inst = random.choice(COMPS)
+    if random.random() < 0.7:
+        inst = f"{random.choice(DESTS)}={inst}"
+    if random.random() < 0.2:
+        inst = f"{inst};{random.choice(JUMPS)}"
+    return inst
+
+
+def main():
+    parser = ArgumentParser(description="Generate a synthetic .asm program.")
+    parser.add_argument("path")
+    parser.add_argument("--insts", type=int, default=MAX_INSTS)
+    parser.add_argument("--label-density", type=float, default=0.05,
+                        help="labels per instruction")
+    parser.add_argument("--vars", type=int, default=128,
+                        help="distinct variables")
+    parser.add_argument("--comment-ratio", type=float, default=0.1,
+                        help="comment-only lines per instruction")
+    parser.add_argument("--line-length", type=int, default=0,
+                        help="pad instruction lines with a trailing comment")
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+    assert 0 < args.insts <= MAX_INSTS
+    random = Random(args.seed)
+    labels = [f"LOOP.{i}" for i in range(int(args.insts * args.label_density))]
+    variables = [f"var.{i}" for i in range(args.vars)]
+    pending = list(labels)
+    random.shuffle(pending)
+    lines = []
+    # NOTE: Labels and comment lines each come in geometric runs before an
+    # instruction, averaging the requested number per instruction.
+    for _ in range(args.insts):
+        while pending and (random.random() < (args.label_density /
+                                              (1.0 + args.label_density))):
+            lines.append(f"({pending.pop()})")
+        while random.random() < (args.comment_ratio /
+                                 (1.0 + args.comment_ratio)):
+            lines.append("// " + "x" * random.randrange(8, 64))
+        line = "    " + get_inst(random, labels, variables)
+        if len(line) + 3 < args.line_length:
+            line += " //" + "-" * (args.line_length - len(line) - 3)
+        lines.append(line)
+    lines.extend(f"({label})" for label in pending)
+    with open(args.path, "w") as file:
+        file.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -17,6 +17,7 @@ flags=(
     -g
     "-march=native"
     -O1
+    -pthread
     "-std=c++11"
     -Werror
     -Weverything
@@ -24,6 +25,7 @@ flags=(
     -Wno-c99-extensions
     -Wno-covered-switch-default
     -Wno-extra-semi-stmt
+    -Wno-gnu-label-as-value
     -Wno-padded
     -Wno-reserved-id-macro
 )
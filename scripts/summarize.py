@@ -0,0 +1,35 @@
+#!/usr/bin/env python3
+
+from json import loads
+from os.path import basename, splitext
+from statistics import mean, median, stdev
+from sys import argv
+
+PHASES = ["read", "parse", "merge", "resolve", "emit", "wall"]
+
+
+def main():
+    print("{:<10} {:<8} {:>9} {:>9} {:>9} {:>7} {:>10} {:>10}".format(
+        "workload", "phase", "median ms", "mean ms", "min ms", "cv %",
+        "MB/s", "Minst/s"))
+    for path in argv[1:]:
+        runs = [loads(line) for line in open(path) if line.strip()]
+        name = splitext(basename(path))[0]
+        size = runs[0]["bytes"]
+        insts = runs[0]["insts"]
+        for phase in PHASES:
+            times = [run["ns"][phase] / 1e6 for run in runs]
+            if max(times) == 0.0:
+                continue
+            middle = median(times)
+            deviation = (stdev(times) / mean(times)) if 1 < len(times) else 0.0
+            print("{:<10} {:<8} {:>9.3f} {:>9.3f} {:>9.3f} {:>7.1f} "
+                  "{:>10.1f} {:>10.2f}".format(
+                      name, phase, middle, mean(times), min(times),
+                      deviation * 100.0, size / middle / 1e3,
+                      insts / middle / 1e3))
+        print()
+
+
+if __name__ == "__main__":
+    main()
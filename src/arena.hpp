@@ -0,0 +1,54 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "prelude.hpp"
+
+#include <sys/mman.h>
+
+struct Arena {
+    u8*   bytes;
+    usize len;
+    usize cap;
+};
+
+static void* alloc(usize size) {
+    void* memory = mmap(null,
+                        size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE,
+                        -1,
+                        0);
+    EXIT_IF(memory == MAP_FAILED);
+    return memory;
+}
+
+// NOTE: The whole of `cap` is reserved up front but only backed by pages as
+// the arena actually reaches them, so a generous `cap` costs nothing.
+static void init(Arena* arena, usize cap) {
+    void* bytes = mmap(null,
+                       cap,
+                       PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE,
+                       -1,
+                       0);
+    EXIT_IF(bytes == MAP_FAILED);
+    arena->bytes = reinterpret_cast<u8*>(bytes);
+    arena->len = 0;
+    arena->cap = cap;
+}
+
+// NOTE: Pages already touched stay mapped, so a reused arena does not fault
+// them in again.
+static void reset(Arena* arena) {
+    arena->len = 0;
+}
+
+template <typename T>
+static T* alloc(Arena* arena, usize len) {
+    const usize offset = (arena->len + (alignof(T) - 1)) & ~(alignof(T) - 1);
+    EXIT_IF(((arena->cap - offset) / sizeof(T)) < len);
+    arena->len = offset + (sizeof(T) * len);
+    return reinterpret_cast<T*>(&arena->bytes[offset]);
+}
+
+#endif
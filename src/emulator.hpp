@@ -0,0 +1,413 @@
+#ifndef __EMULATOR_H__
+#define __EMULATOR_H__
+
+#include "hack.hpp"
+
+#define CAP_ROM (MAX_U15 + 1u)
+#define CAP_RAM (MAX_U15 + 1u)
+
+// NOTE: Every ROM word is decoded up front into the addresses of the code
+// that carries it out, so running a program is a chain of indirect jumps
+// with no decoding in between. A C-instruction takes two of them: `compute`
+// sets the ALU output from its `comp` bits, then `store` sends the output
+// to its `dest` and takes its `jump`. An A-instruction is just `compute`,
+// which loads `word` into `a`.
+//
+// An A-instruction followed by one of a few common C-instructions is also
+// fused into a single `compute` that does both, with `word` folded in.
+// The C-instruction keeps its own op, so a jump straight to it still
+// lands.
+struct Op {
+    const void* compute;
+    const void* store;
+    u16         word;
+};
+
+enum Halt {
+    HALT_CYCLES = 0,
+    HALT_PC,
+};
+
+// NOTE: The CPU as the hardware builds it: a 32K-word ROM, zero (that is,
+// `@0`) past the program, and a 32K-word RAM with the screen and keyboard
+// maps in it. Both buses are 15 bits wide, so an address or a jump target
+// drops the top bit of `a`. `ops` keeps one entry past the ROM, through
+// which `pc` wraps around to 0.
+struct Emulator {
+    Op   ops[CAP_ROM + 1];
+    u16  rom[CAP_ROM];
+    u16  ram[CAP_RAM];
+    u64  cycles;
+    u16  a;
+    u16  d;
+    u32  len_fused;
+    u16  pc;
+    bool decoded;
+};
+
+static void load(Emulator* emulator, const u16* insts, u32 len) {
+    EXIT_IF(CAP_ROM < len);
+    memcpy(emulator->rom, insts, sizeof(u16) * len);
+    memset(&emulator->rom[len], 0, sizeof(u16) * (CAP_ROM - len));
+    memset(emulator->ram, 0, sizeof(emulator->ram));
+    emulator->cycles = 0;
+    emulator->a = 0;
+    emulator->d = 0;
+    emulator->len_fused = 0;
+    emulator->pc = 0;
+    emulator->decoded = false;
+}
+
+// NOTE: The ALU run straight off its control bits (`zx`, `nx`, `zy`, `ny`,
+// `f`, `no`), for `comp` bits that are none of the named computations.
+static u16 get_alu(u32 comp, u16 x, u16 y) {
+    if (comp & 0x20u) {
+        x = 0;
+    }
+    if (comp & 0x10u) {
+        x = static_cast<u16>(~x);
+    }
+    if (comp & 0x08u) {
+        y = 0;
+    }
+    if (comp & 0x04u) {
+        y = static_cast<u16>(~y);
+    }
+    const u16 out = (comp & 0x02u) ? static_cast<u16>(x + y)
+                                   : static_cast<u16>(x & y);
+    return (comp & 0x01u) ? static_cast<u16>(~out) : out;
+}
+
+static bool is_taken(u32 jump, u16 out) {
+    const i16 x = static_cast<i16>(out);
+    switch (jump) {
+    case JUMP_NULL: {
+        return false;
+    }
+    case JUMP_JGT: {
+        return 0 < x;
+    }
+    case JUMP_JEQ: {
+        return x == 0;
+    }
+    case JUMP_JGE: {
+        return 0 <= x;
+    }
+    case JUMP_JLT: {
+        return x < 0;
+    }
+    case JUMP_JNE: {
+        return x != 0;
+    }
+    case JUMP_JLE: {
+        return x <= 0;
+    }
+    case JUMP_JMP: {
+        return true;
+    }
+    default: {
+        EXIT();
+    }
+    }
+}
+
+#define M (ram[a & MAX_U15])
+
+#define NEXT                  \
+    {                         \
+        if (left == 0) {      \
+            goto halt_cycles; \
+        }                     \
+        --left;               \
+        goto *op->compute;    \
+    }
+
+// NOTE: A fused pair is two cycles; with just one left, only its
+// A-instruction runs.
+#define FUSE                 \
+    {                        \
+        if (left == 0) {     \
+            goto load_a;     \
+        }                    \
+        --left;              \
+    }
+
+#define COMPUTE(x)                 \
+    {                              \
+        out = static_cast<u16>(x); \
+        goto *op->store;           \
+    }
+
+// NOTE: As in the hardware, `M` and the jump target are both taken from `a`
+// as it was before the instruction, even when `dest` loads it.
+#define STORE(dest, jump)                                           \
+    store_##dest##_##jump : {                                       \
+        const u16 target = a;                                       \
+        if ((dest) & DEST_M) {                                      \
+            M = out;                                                \
+        }                                                           \
+        if ((dest) & DEST_D) {                                      \
+            d = out;                                                \
+        }                                                           \
+        if ((dest) & DEST_A) {                                      \
+            a = out;                                                \
+        }                                                           \
+        op = is_taken(jump, out) ? &ops[target & MAX_U15] : op + 1; \
+        NEXT;                                                       \
+    }
+
+#define STORES(dest) \
+    STORE(dest, 0)   \
+    STORE(dest, 1)   \
+    STORE(dest, 2)   \
+    STORE(dest, 3)   \
+    STORE(dest, 4)   \
+    STORE(dest, 5)   \
+    STORE(dest, 6)   \
+    STORE(dest, 7)
+
+#define STORES_OF(dest)                                             \
+    &&store_##dest##_0, &&store_##dest##_1, &&store_##dest##_2,     \
+        &&store_##dest##_3, &&store_##dest##_4, &&store_##dest##_5, \
+        &&store_##dest##_6, &&store_##dest##_7
+
+// NOTE: Runs for at most `len_cycles` instructions, or until `pc` reaches
+// `until` (if that is in the ROM), whichever comes first; a run that
+// starts on `until` stops at once. `until` is caught by pointing its op at
+// `halt_pc` for the length of the run, so the hot path never checks it.
+static Halt emulate(Emulator* emulator, u64 len_cycles, u32 until) {
+    static const void* const STORES_BY_BITS[1u << 6] = {
+        STORES_OF(0),
+        STORES_OF(1),
+        STORES_OF(2),
+        STORES_OF(3),
+        STORES_OF(4),
+        STORES_OF(5),
+        STORES_OF(6),
+        STORES_OF(7),
+    };
+    Op* ops = emulator->ops;
+    if (!emulator->decoded) {
+        const void* computes[1u << 7];
+        for (u32 i = 0; i < (1u << 7); ++i) {
+            computes[i] = &&compute_alu;
+        }
+        computes[COMP_ZERO] = &&compute_zero;
+        computes[COMP_ONE] = &&compute_one;
+        computes[COMP_NEGATIVE_ONE] = &&compute_negative_one;
+        computes[COMP_D] = &&compute_d;
+        computes[COMP_A] = &&compute_a;
+        computes[COMP_M] = &&compute_m;
+        computes[COMP_NOT_D] = &&compute_not_d;
+        computes[COMP_NOT_A] = &&compute_not_a;
+        computes[COMP_NOT_M] = &&compute_not_m;
+        computes[COMP_NEGATIVE_D] = &&compute_negative_d;
+        computes[COMP_NEGATIVE_A] = &&compute_negative_a;
+        computes[COMP_NEGATIVE_M] = &&compute_negative_m;
+        computes[COMP_D_PLUS_1] = &&compute_d_plus_1;
+        computes[COMP_A_PLUS_1] = &&compute_a_plus_1;
+        computes[COMP_M_PLUS_1] = &&compute_m_plus_1;
+        computes[COMP_D_MINUS_1] = &&compute_d_minus_1;
+        computes[COMP_A_MINUS_1] = &&compute_a_minus_1;
+        computes[COMP_M_MINUS_1] = &&compute_m_minus_1;
+        computes[COMP_D_PLUS_A] = &&compute_d_plus_a;
+        computes[COMP_D_PLUS_M] = &&compute_d_plus_m;
+        computes[COMP_D_MINUS_A] = &&compute_d_minus_a;
+        computes[COMP_D_MINUS_M] = &&compute_d_minus_m;
+        computes[COMP_A_MINUS_D] = &&compute_a_minus_d;
+        computes[COMP_M_MINUS_D] = &&compute_m_minus_d;
+        computes[COMP_D_AND_A] = &&compute_d_and_a;
+        computes[COMP_D_AND_M] = &&compute_d_and_m;
+        computes[COMP_D_OR_A] = &&compute_d_or_a;
+        computes[COMP_D_OR_M] = &&compute_d_or_m;
+        for (u32 i = 0; i < CAP_ROM; ++i) {
+            const u32 word = emulator->rom[i];
+            ops[i].word = static_cast<u16>(word);
+            if ((word & 0x8000u) == 0) {
+                ops[i].compute = &&load_a;
+                ops[i].store = null;
+            } else {
+                ops[i].compute = computes[(word >> 6u) & 0x7Fu];
+                ops[i].store = STORES_BY_BITS[word & 0x3Fu];
+            }
+        }
+        ops[CAP_ROM].compute = &&wrap;
+        ops[CAP_ROM].store = null;
+        for (u32 i = 0; (i + 1) < CAP_ROM; ++i) {
+            if (ops[i].compute != &&load_a) {
+                continue;
+            }
+            switch (emulator->rom[i + 1]) {
+            case get_compute(COMP_M, DEST_D, JUMP_NULL): {
+                ops[i].compute = &&fuse_d_eq_m;
+                break;
+            }
+            case get_compute(COMP_D, DEST_M, JUMP_NULL): {
+                ops[i].compute = &&fuse_m_eq_d;
+                break;
+            }
+            case get_compute(COMP_D_PLUS_M, DEST_M, JUMP_NULL): {
+                ops[i].compute = &&fuse_m_eq_d_plus_m;
+                break;
+            }
+            case get_compute(COMP_ZERO, DEST_NULL, JUMP_JMP): {
+                ops[i].compute = &&fuse_jmp;
+                break;
+            }
+            default: {
+                continue;
+            }
+            }
+            ++emulator->len_fused;
+        }
+        emulator->decoded = true;
+    }
+    // NOTE: A pair ending on `until` would step right over it, so the pair
+    // comes apart for the run.
+    const void* resumed = null;
+    const void* split = null;
+    if (until < CAP_ROM) {
+        resumed = ops[until].compute;
+        ops[until].compute = &&halt_pc;
+        if ((until != 0) && ((ops[until - 1].word & 0x8000u) == 0)) {
+            split = ops[until - 1].compute;
+            ops[until - 1].compute = &&load_a;
+        }
+    }
+    u16* ram = emulator->ram;
+    Op*  op = &ops[emulator->pc];
+    u16  a = emulator->a;
+    u16  d = emulator->d;
+    u16  out = 0;
+    u64  left = len_cycles;
+    Halt halt;
+    NEXT;
+load_a:
+    a = op->word;
+    ++op;
+    NEXT;
+compute_zero:
+    COMPUTE(0);
+compute_one:
+    COMPUTE(1);
+compute_negative_one:
+    COMPUTE(-1);
+compute_d:
+    COMPUTE(d);
+compute_a:
+    COMPUTE(a);
+compute_m:
+    COMPUTE(M);
+compute_not_d:
+    COMPUTE(~d);
+compute_not_a:
+    COMPUTE(~a);
+compute_not_m:
+    COMPUTE(~M);
+compute_negative_d:
+    COMPUTE(-d);
+compute_negative_a:
+    COMPUTE(-a);
+compute_negative_m:
+    COMPUTE(-M);
+compute_d_plus_1:
+    COMPUTE(d + 1);
+compute_a_plus_1:
+    COMPUTE(a + 1);
+compute_m_plus_1:
+    COMPUTE(M + 1);
+compute_d_minus_1:
+    COMPUTE(d - 1);
+compute_a_minus_1:
+    COMPUTE(a - 1);
+compute_m_minus_1:
+    COMPUTE(M - 1);
+compute_d_plus_a:
+    COMPUTE(d + a);
+compute_d_plus_m:
+    COMPUTE(d + M);
+compute_d_minus_a:
+    COMPUTE(d - a);
+compute_d_minus_m:
+    COMPUTE(d - M);
+compute_a_minus_d:
+    COMPUTE(a - d);
+compute_m_minus_d:
+    COMPUTE(M - d);
+compute_d_and_a:
+    COMPUTE(d & a);
+compute_d_and_m:
+    COMPUTE(d & M);
+compute_d_or_a:
+    COMPUTE(d | a);
+compute_d_or_m:
+    COMPUTE(d | M);
+compute_alu:
+    COMPUTE(get_alu(static_cast<u32>(op->word) >> 6u,
+                    d,
+                    (static_cast<u32>(op->word) & 0x1000u) ? M : a));
+    // NOTE: The word of an A-instruction already is a 15-bit address.
+fuse_d_eq_m:
+    FUSE;
+    a = op->word;
+    d = ram[a];
+    op += 2;
+    NEXT;
+fuse_m_eq_d:
+    FUSE;
+    a = op->word;
+    ram[a] = d;
+    op += 2;
+    NEXT;
+fuse_m_eq_d_plus_m:
+    FUSE;
+    a = op->word;
+    ram[a] = static_cast<u16>(d + ram[a]);
+    op += 2;
+    NEXT;
+fuse_jmp:
+    FUSE;
+    a = op->word;
+    op = &ops[a];
+    NEXT;
+    STORES(0)
+    STORES(1)
+    STORES(2)
+    STORES(3)
+    STORES(4)
+    STORES(5)
+    STORES(6)
+    STORES(7)
+wrap:
+    // NOTE: The cycle was already counted against the op at 0.
+    op = ops;
+    goto *op->compute;
+halt_pc:
+    ++left;
+    halt = HALT_PC;
+    goto done;
+halt_cycles:
+    halt = HALT_CYCLES;
+done:
+    if (until < CAP_ROM) {
+        ops[until].compute = resumed;
+        if (split) {
+            ops[until - 1].compute = split;
+        }
+    }
+    emulator->cycles += len_cycles - left;
+    emulator->pc = static_cast<u16>(static_cast<u32>(op - ops) & MAX_U15);
+    emulator->a = a;
+    emulator->d = d;
+    return halt;
+}
+
+#undef M
+#undef NEXT
+#undef FUSE
+#undef COMPUTE
+#undef STORE
+#undef STORES
+#undef STORES_OF
+
+#endif
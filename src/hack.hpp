@@ -0,0 +1,104 @@
+#ifndef __HACK_H__
+#define __HACK_H__
+
+#include "prelude.hpp"
+
+#define MAX_U15 0x7FFF
+
+#define INST_COMPUTE_BITS 0xE000u
+
+// clang-format off
+enum SymbolComp {
+    COMP_ZERO         = 0x2A,
+    COMP_ONE          = 0x3F,
+    COMP_NEGATIVE_ONE = 0x3A,
+    COMP_D            = 0x0C,
+    COMP_A            = 0x30,
+    COMP_M            = 0x70,
+    COMP_NOT_D        = 0x0D,
+    COMP_NOT_A        = 0x31,
+    COMP_NOT_M        = 0x71,
+    COMP_NEGATIVE_D   = 0x0F,
+    COMP_NEGATIVE_A   = 0x33,
+    COMP_NEGATIVE_M   = 0x73,
+    COMP_D_PLUS_1     = 0x1F,
+    COMP_A_PLUS_1     = 0x37,
+    COMP_M_PLUS_1     = 0x77,
+    COMP_D_MINUS_1    = 0x0E,
+    COMP_A_MINUS_1    = 0x32,
+    COMP_M_MINUS_1    = 0x72,
+    COMP_D_PLUS_A     = 0x02,
+    COMP_D_PLUS_M     = 0x42,
+    COMP_D_MINUS_A    = 0x13,
+    COMP_D_MINUS_M    = 0x53,
+    COMP_A_MINUS_D    = 0x07,
+    COMP_M_MINUS_D    = 0x47,
+    COMP_D_AND_A      = 0x00,
+    COMP_D_AND_M      = 0x40,
+    COMP_D_OR_A       = 0x15,
+    COMP_D_OR_M       = 0x55,
+};
+
+#define COMP_INVALID 0xFF
+
+enum SymbolDest {
+    DEST_NULL = 0x00,
+    DEST_M    = 0x01,
+    DEST_D    = 0x02,
+    DEST_MD   = 0x03,
+    DEST_A    = 0x04,
+    DEST_AM   = 0x05,
+    DEST_AD   = 0x06,
+    DEST_AMD  = 0x07,
+};
+
+enum SymbolJump {
+    JUMP_NULL = 0x00,
+    JUMP_JGT  = 0x01,
+    JUMP_JEQ  = 0x02,
+    JUMP_JGE  = 0x03,
+    JUMP_JLT  = 0x04,
+    JUMP_JNE  = 0x05,
+    JUMP_JLE  = 0x06,
+    JUMP_JMP  = 0x07,
+};
+
+enum SymbolPreDef {
+    PREDEF_R0_SP   = 0x0000,
+    PREDEF_R1_LCL  = 0x0001,
+    PREDEF_R2_ARG  = 0x0002,
+    PREDEF_R3_THIS = 0x0003,
+    PREDEF_R4_THAT = 0x0004,
+    PREDEF_R5      = 0x0005,
+    PREDEF_R6      = 0x0006,
+    PREDEF_R7      = 0x0007,
+    PREDEF_R8      = 0x0008,
+    PREDEF_R9      = 0x0009,
+    PREDEF_R10     = 0x000A,
+    PREDEF_R11     = 0x000B,
+    PREDEF_R12     = 0x000C,
+    PREDEF_R13     = 0x000D,
+    PREDEF_R14     = 0x000E,
+    PREDEF_R15     = 0x000F,
+    PREDEF_SCREEN  = 0x4000,
+    PREDEF_KBD     = 0x6000,
+};
+
+// clang-format on
+
+struct InstCompute {
+    SymbolComp comp;
+    SymbolDest dest;
+    SymbolJump jump;
+};
+
+static constexpr u16 get_compute(SymbolComp comp,
+                                 SymbolDest dest,
+                                 SymbolJump jump) {
+    return static_cast<u16>(INST_COMPUTE_BITS |
+                            (static_cast<u32>(comp) << 6u) |
+                            (static_cast<u32>(dest) << 3u) |
+                            static_cast<u32>(jump));
+}
+
+#endif
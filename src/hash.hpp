@@ -1,6 +1,8 @@
 #ifndef __HASH_H__
 #define __HASH_H__
 
+#include "arena.hpp"
+#include "simd.hpp"
 #include "str.hpp"
 
 template <typename K, typename V>
@@ -17,6 +19,42 @@ struct Table {
     u32        collisions;
 };
 
+// NOTE: `Map` is the growable counterpart of `Table`; its capacity stays a
+// power of two and it doubles into fresh arena storage whenever `len` would
+// pass `load` percent of `cap`. Slots are probed `MAP_GROUP` at a time, with
+// one control byte per slot: `CONTROL_EMPTY`, or the low seven bits of the
+// key's hash, so most mismatches are ruled out without touching `items`.
+// `collisions` counts groups probed past the first, over all `lookups`;
+// `max_probes` is the most groups any one lookup probed.
+template <typename K, typename V>
+struct Map {
+    Arena*      arena;
+    u8*         controls;
+    Item<K, V>* items;
+    u32         cap;
+    u32         len;
+    u32         load;
+    u32         collisions;
+    u32         lookups;
+    u32         max_probes;
+};
+
+#ifdef SIMD_WIDTH
+    #define MAP_GROUP SIMD_WIDTH
+#else
+    #define MAP_GROUP 16
+#endif
+
+#define CONTROL_EMPTY 0x80u
+
+// NOTE: A `String` with its hash computed once, up front; tables keyed on it
+// never rehash, and compare hashes before bytes.
+struct Key {
+    const char* chars;
+    u32         len;
+    u32         hash;
+};
+
 #define FNV_32_PRIME        16777619u
 #define FNV_32_OFFSET_BASIS 2166136261u
 
@@ -71,4 +109,170 @@ static void insert(Table<K, V, N>* table, K key, V value) {
     table->items[i] = {key, value, true};
 }
 
+static Key to_key(String string) {
+    return {string.chars, string.len, hash(string)};
+}
+
+static u32 hash(Key key) {
+    return key.hash;
+}
+
+static bool operator==(Key a, Key b) {
+    return (a.hash == b.hash) && (a.len == b.len) &&
+           (!memcmp(a.chars, b.chars, a.len));
+}
+
+#ifdef DEBUG
+
+static void print(File* stream, Key key) {
+    print(stream, (String){key.chars, key.len});
+}
+
+#endif
+
+// NOTE: Bit `i` of the result is set when `controls[i] == control`.
+static u32 match(const u8* controls, u8 control) {
+#ifdef SIMD_WIDTH
+    return to_mask(eq(load(reinterpret_cast<const char*>(controls)),
+                      splat(static_cast<char>(control))));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < MAP_GROUP; ++i) {
+        if (controls[i] == control) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+// NOTE: Only `CONTROL_EMPTY` has its high bit set.
+static u32 match_empty(const u8* controls) {
+#ifdef SIMD_WIDTH
+    return to_mask(load(reinterpret_cast<const char*>(controls)));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < MAP_GROUP; ++i) {
+        if (controls[i] & CONTROL_EMPTY) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+static u8 to_control(u32 h) {
+    return static_cast<u8>(h & 0x7Fu);
+}
+
+template <typename K, typename V>
+static void set_items(Map<K, V>* map, u32 cap) {
+    map->controls = alloc<u8>(map->arena, cap);
+    memset(map->controls, CONTROL_EMPTY, cap);
+    map->items = alloc<Item<K, V>>(map->arena, cap);
+    map->cap = cap;
+}
+
+template <typename K, typename V>
+static void init(Map<K, V>* map, Arena* arena, u32 cap, u32 load) {
+    EXIT_IF((cap < MAP_GROUP) || ((cap & (cap - 1)) != 0));
+    EXIT_IF((load == 0) || (100 <= load));
+    map->arena = arena;
+    set_items(map, cap);
+    map->len = 0;
+    map->load = load;
+    map->collisions = 0;
+    map->lookups = 0;
+    map->max_probes = 0;
+}
+
+template <typename K, typename V>
+static void add_probes(Map<K, V>* map, u32 collisions) {
+    map->collisions += collisions;
+    ++map->lookups;
+    if (map->max_probes <= collisions) {
+        map->max_probes = collisions + 1;
+    }
+}
+
+template <typename K, typename V>
+static u32 find_slot(Map<K, V>* map, K key) {
+    const u32 h = hash(key);
+    const u8  control = to_control(h);
+    const u32 mask = (map->cap / MAP_GROUP) - 1;
+    // NOTE: `load` is kept below 100, so some group always has an empty slot
+    // to stop at. Nothing is ever removed, so a key is never found past the
+    // first group with room in it.
+    for (u32 i = 0, j = (h >> 7u) & mask;; ++i, j = (j + 1) & mask) {
+        const u8* controls = &map->controls[j * MAP_GROUP];
+        for (u32 matches = match(controls, control); matches != 0;
+             matches &= matches - 1)
+        {
+            const u32 k =
+                (j * MAP_GROUP) + static_cast<u32>(__builtin_ctz(matches));
+            if (map->items[k].key == key) {
+                add_probes(map, i);
+                return k;
+            }
+        }
+        const u32 empty = match_empty(controls);
+        if (empty != 0) {
+#ifdef DEBUG
+            if (i != 0) {
+                print(stderr, key);
+                fprintf(stderr, " (%u)\n", i);
+            }
+#endif
+            add_probes(map, i);
+            return (j * MAP_GROUP) + static_cast<u32>(__builtin_ctz(empty));
+        }
+    }
+}
+
+template <typename K, typename V>
+static void grow(Map<K, V>* map) {
+    const u8*         controls = map->controls;
+    const Item<K, V>* items = map->items;
+    const u32         cap = map->cap;
+    const u32         collisions = map->collisions;
+    const u32         lookups = map->lookups;
+    const u32         max_probes = map->max_probes;
+    EXIT_IF((UINT32_MAX >> 1) < cap);
+    set_items(map, cap << 1);
+    for (u32 i = 0; i < cap; ++i) {
+        if (controls[i] != CONTROL_EMPTY) {
+            const u32 j = find_slot(map, items[i].key);
+            map->controls[j] = controls[i];
+            map->items[j] = items[i];
+        }
+    }
+    map->collisions = collisions;
+    map->lookups = lookups;
+    map->max_probes = max_probes;
+}
+
+template <typename K, typename V>
+static V* lookup(Map<K, V>* map, K key) {
+    const u32 i = find_slot(map, key);
+    if (map->controls[i] != CONTROL_EMPTY) {
+        return &map->items[i].value;
+    }
+    return null;
+}
+
+template <typename K, typename V>
+static void insert(Map<K, V>* map, K key, V value) {
+    if ((static_cast<u64>(map->cap) * map->load) <=
+        (static_cast<u64>(map->len + 1) * 100))
+    {
+        grow(map);
+    }
+    const u32 i = find_slot(map, key);
+    if (map->controls[i] == CONTROL_EMPTY) {
+        map->controls[i] = to_control(hash(key));
+        ++map->len;
+    }
+    map->items[i] = {key, value, true};
+}
+
 #endif
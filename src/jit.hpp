@@ -0,0 +1,631 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "arena.hpp"
+#include "emulator.hpp"
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__)
+
+    #define CAP_CODE       (1ul << 24)
+    #define LEN_BLOCK      (1u << 8)
+    #define CAP_INST_CODE  (1u << 7)
+    #define CAP_BLOCK_CODE (((LEN_BLOCK + 1u) * CAP_INST_CODE))
+
+// NOTE: A block is the straight run of ROM from wherever control enters it
+// up to and including the first C-instruction that can jump, so every
+// label that is actually jumped to starts one. A run with no such jump is
+// cut at the next multiple of `LEN_BLOCK` instead, so code entered at many
+// points along it still shares the blocks that follow. A block's code
+// checks at entry that the cycle budget covers all of it, runs it with
+// `a`, `d` and the RAM in registers, then jumps through `entries` straight
+// into the next block. Anything not (yet) compiled, a block that holds the
+// stop address, and a budget too small all lead out to the dispatcher,
+// which leaves the exact finish to the interpreter. ROM is never written,
+// so compiled code can only go stale when the ROM is reloaded.
+struct Block {
+    const u8* code;
+    u32       len;
+};
+
+// NOTE: Shared with the generated code, at the offsets it hard-codes.
+struct Context {
+    u16*       ram;
+    const u8** entries;
+    u64        left;
+    u32        a;
+    u32        d;
+    u32        pc;
+};
+
+STATIC_ASSERT((CAP_ROM % LEN_BLOCK) == 0);
+STATIC_ASSERT(offsetof(Context, ram) == 0);
+STATIC_ASSERT(offsetof(Context, entries) == 8);
+STATIC_ASSERT(offsetof(Context, left) == 16);
+STATIC_ASSERT(offsetof(Context, a) == 24);
+STATIC_ASSERT(offsetof(Context, d) == 28);
+STATIC_ASSERT(offsetof(Context, pc) == 32);
+
+typedef void (*Enter)(Context* context, const u8* code);
+
+struct Jit {
+    Block     blocks[CAP_ROM];
+    const u8* entries[CAP_ROM];
+    u8*       code;
+    const u8* exit;
+    Enter     enter;
+    usize     len_code;
+    usize     len_trampoline;
+    u32       len_blocks;
+};
+
+// NOTE: `a` lives in `ebx` and `d` in `ebp`, both zero-extended. `eax`
+// takes the ALU output, `edx` its `y` operand, `ecx` a RAM address or the
+// next `pc`, and `esi` a jump target. `r12` holds the RAM, `r13` the
+// entries, `r14` the cycles left and `r15` the `Context`.
+enum Reg {
+    REG_AX = 0,
+    REG_CX,
+    REG_DX,
+    REG_BX,
+    REG_SP,
+    REG_BP,
+    REG_SI,
+    REG_DI,
+};
+
+    #define REG_OUT     REG_AX
+    #define REG_ADDRESS REG_CX
+    #define REG_Y       REG_DX
+    #define REG_A       REG_BX
+    #define REG_D       REG_BP
+    #define REG_TARGET  REG_SI
+
+enum Opcode {
+    OPCODE_ADD  = 0x01,
+    OPCODE_OR   = 0x09,
+    OPCODE_AND  = 0x21,
+    OPCODE_SUB  = 0x29,
+    OPCODE_XOR  = 0x31,
+    OPCODE_TEST = 0x85,
+    OPCODE_MOV  = 0x89,
+};
+
+// NOTE: The `/digit` that picks the operation of opcodes `0x83` and `0xF7`.
+enum Extension {
+    EXTENSION_ADD = 0,
+    EXTENSION_NOT = 2,
+    EXTENSION_NEG = 3,
+    EXTENSION_AND = 4,
+    EXTENSION_SUB = 5,
+};
+
+// NOTE: Condition codes of `cmovcc`, after `test ax, ax`.
+enum Condition {
+    CONDITION_E  = 0x4,
+    CONDITION_NE = 0x5,
+    CONDITION_L  = 0xC,
+    CONDITION_GE = 0xD,
+    CONDITION_LE = 0xE,
+    CONDITION_G  = 0xF,
+};
+
+static void put(Jit* jit, u8 byte) {
+    jit->code[jit->len_code++] = byte;
+}
+
+static void put_u32(Jit* jit, u32 x) {
+    memcpy(&jit->code[jit->len_code], &x, sizeof(u32));
+    jit->len_code += sizeof(u32);
+}
+
+static void put_modrm(Jit* jit, u32 mod, u32 reg, u32 rm) {
+    put(jit, static_cast<u8>((mod << 6u) | (reg << 3u) | rm));
+}
+
+// NOTE: `op dst, src`, on 32 bits.
+static void put_rr(Jit* jit, Opcode opcode, Reg dst, Reg src) {
+    put(jit, opcode);
+    put_modrm(jit, 3, src, dst);
+}
+
+static void put_ri(Jit* jit, Reg dst, u32 x) {
+    put(jit, static_cast<u8>(0xB8u + dst));
+    put_u32(jit, x);
+}
+
+static void put_unary(Jit* jit, Extension extension, Reg reg) {
+    put(jit, 0xF7);
+    put_modrm(jit, 3, extension, reg);
+}
+
+static void put_ri8(Jit* jit, Extension extension, Reg reg, u8 x) {
+    put(jit, 0x83);
+    put_modrm(jit, 3, extension, reg);
+    put(jit, x);
+}
+
+static void put_mask(Jit* jit, Reg reg) {
+    put(jit, 0x81);
+    put_modrm(jit, 3, EXTENSION_AND, reg);
+    put_u32(jit, MAX_U15);
+}
+
+// NOTE: `movzx reg, reg16`.
+static void put_truncate(Jit* jit, Reg reg) {
+    put(jit, 0x0F);
+    put(jit, 0xB7);
+    put_modrm(jit, 3, reg, reg);
+}
+
+// NOTE: `movzx edx, word [r12 + rcx * 2]`, or at a known address.
+static void put_load(Jit* jit, bool known, u32 address) {
+    put(jit, 0x41);
+    put(jit, 0x0F);
+    put(jit, 0xB7);
+    if (known) {
+        put(jit, 0x94);
+        put(jit, 0x24);
+        put_u32(jit, address * 2);
+    } else {
+        put(jit, 0x14);
+        put(jit, 0x4C);
+    }
+}
+
+// NOTE: `mov word [r12 + rcx * 2], ax`, or at a known address.
+static void put_store(Jit* jit, bool known, u32 address) {
+    put(jit, 0x66);
+    put(jit, 0x41);
+    put(jit, 0x89);
+    if (known) {
+        put(jit, 0x84);
+        put(jit, 0x24);
+        put_u32(jit, address * 2);
+    } else {
+        put(jit, 0x04);
+        put(jit, 0x4C);
+    }
+}
+
+// NOTE: `jmp [r13 + rcx * 8]`, into whatever runs the `pc` in `ecx`.
+static void put_next(Jit* jit) {
+    put(jit, 0x41);
+    put(jit, 0xFF);
+    put(jit, 0x64);
+    put(jit, 0xCD);
+    put(jit, 0x00);
+}
+
+static void put_exit(Jit* jit, u32 pc) {
+    put_ri(jit, REG_ADDRESS, pc);
+    put(jit, 0xE9);
+    put_u32(jit,
+            static_cast<u32>(jit->exit - &jit->code[jit->len_code + 4]));
+}
+
+static void put_goto(Jit* jit, u32 pc) {
+    put_ri(jit, REG_ADDRESS, pc);
+    put_next(jit);
+}
+
+// NOTE: Leaves `comp` of `d` and `y` in `eax`; `y` has already been put
+// in `edx` (as `a` or `M`) unless `comp` zeroes it. Each named computation
+// is keyed by its `a` form, which stands for its `M` form too; anything
+// else is run through the ALU bit by bit.
+static void put_comp(Jit* jit, u32 comp) {
+    switch (comp & 0x3Fu) {
+    case COMP_ZERO: {
+        put_rr(jit, OPCODE_XOR, REG_OUT, REG_OUT);
+        return;
+    }
+    case COMP_ONE: {
+        put_ri(jit, REG_OUT, 1);
+        return;
+    }
+    case COMP_NEGATIVE_ONE: {
+        put_ri(jit, REG_OUT, 0xFFFF);
+        return;
+    }
+    case COMP_D: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        return;
+    }
+    case COMP_A: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_Y);
+        return;
+    }
+    case COMP_NOT_D: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_unary(jit, EXTENSION_NOT, REG_OUT);
+        break;
+    }
+    case COMP_NOT_A: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_Y);
+        put_unary(jit, EXTENSION_NOT, REG_OUT);
+        break;
+    }
+    case COMP_NEGATIVE_D: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_unary(jit, EXTENSION_NEG, REG_OUT);
+        break;
+    }
+    case COMP_NEGATIVE_A: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_Y);
+        put_unary(jit, EXTENSION_NEG, REG_OUT);
+        break;
+    }
+    case COMP_D_PLUS_1: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_ri8(jit, EXTENSION_ADD, REG_OUT, 1);
+        break;
+    }
+    case COMP_A_PLUS_1: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_Y);
+        put_ri8(jit, EXTENSION_ADD, REG_OUT, 1);
+        break;
+    }
+    case COMP_D_MINUS_1: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_ri8(jit, EXTENSION_SUB, REG_OUT, 1);
+        break;
+    }
+    case COMP_A_MINUS_1: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_Y);
+        put_ri8(jit, EXTENSION_SUB, REG_OUT, 1);
+        break;
+    }
+    case COMP_D_PLUS_A: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_rr(jit, OPCODE_ADD, REG_OUT, REG_Y);
+        break;
+    }
+    case COMP_D_MINUS_A: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_rr(jit, OPCODE_SUB, REG_OUT, REG_Y);
+        break;
+    }
+    case COMP_A_MINUS_D: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_Y);
+        put_rr(jit, OPCODE_SUB, REG_OUT, REG_D);
+        break;
+    }
+    case COMP_D_AND_A: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_rr(jit, OPCODE_AND, REG_OUT, REG_Y);
+        return;
+    }
+    case COMP_D_OR_A: {
+        put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        put_rr(jit, OPCODE_OR, REG_OUT, REG_Y);
+        return;
+    }
+    default: {
+        if (comp & 0x20u) {
+            put_rr(jit, OPCODE_XOR, REG_OUT, REG_OUT);
+        } else {
+            put_rr(jit, OPCODE_MOV, REG_OUT, REG_D);
+        }
+        if (comp & 0x10u) {
+            put_unary(jit, EXTENSION_NOT, REG_OUT);
+        }
+        if (comp & 0x08u) {
+            put_rr(jit, OPCODE_XOR, REG_Y, REG_Y);
+        }
+        if (comp & 0x04u) {
+            put_unary(jit, EXTENSION_NOT, REG_Y);
+        }
+        put_rr(jit,
+               (comp & 0x02u) ? OPCODE_ADD : OPCODE_AND,
+               REG_OUT,
+               REG_Y);
+        if (comp & 0x01u) {
+            put_unary(jit, EXTENSION_NOT, REG_OUT);
+        }
+    }
+    }
+    put_truncate(jit, REG_OUT);
+}
+
+static Condition get_condition(u32 jump) {
+    switch (jump) {
+    case JUMP_JGT: {
+        return CONDITION_G;
+    }
+    case JUMP_JEQ: {
+        return CONDITION_E;
+    }
+    case JUMP_JGE: {
+        return CONDITION_GE;
+    }
+    case JUMP_JLT: {
+        return CONDITION_L;
+    }
+    case JUMP_JNE: {
+        return CONDITION_NE;
+    }
+    case JUMP_JLE: {
+        return CONDITION_LE;
+    }
+    case JUMP_NULL:
+    case JUMP_JMP:
+    default: {
+        EXIT();
+    }
+    }
+}
+
+// NOTE: Puts one C-instruction at `pc`. `known` says whether `a` still
+// holds the `address` an A-instruction in this block gave it; if so, `M`
+// is addressed directly. As in the interpreter, `M` and the jump target
+// are taken from `a` before `dest` changes it.
+static void put_compute(Jit* jit, u32 word, u32 pc, bool* known, u32 address) {
+    const u32 comp = (word >> 6u) & 0x7Fu;
+    const u32 dest = (word >> 3u) & 0x7u;
+    const u32 jump = word & 0x7u;
+    const bool m = (comp & 0x40u) != 0;
+    const bool y = (comp & 0x08u) == 0;
+    if (!*known && ((m && y) || (dest & DEST_M))) {
+        put_rr(jit, OPCODE_MOV, REG_ADDRESS, REG_A);
+        put_mask(jit, REG_ADDRESS);
+    }
+    if (y) {
+        if (m) {
+            put_load(jit, *known, address);
+        } else {
+            put_rr(jit, OPCODE_MOV, REG_Y, REG_A);
+        }
+    }
+    put_comp(jit, comp);
+    if (jump != JUMP_NULL) {
+        if (*known) {
+            put_ri(jit, REG_TARGET, address);
+        } else {
+            put_rr(jit, OPCODE_MOV, REG_TARGET, REG_A);
+            put_mask(jit, REG_TARGET);
+        }
+    }
+    if (dest & DEST_M) {
+        put_store(jit, *known, address);
+    }
+    if (dest & DEST_D) {
+        put_rr(jit, OPCODE_MOV, REG_D, REG_OUT);
+    }
+    if (dest & DEST_A) {
+        put_rr(jit, OPCODE_MOV, REG_A, REG_OUT);
+        *known = false;
+    }
+    if (jump == JUMP_NULL) {
+        return;
+    }
+    if (jump == JUMP_JMP) {
+        put_rr(jit, OPCODE_MOV, REG_ADDRESS, REG_TARGET);
+    } else {
+        put(jit, 0x66);
+        put_rr(jit, OPCODE_TEST, REG_OUT, REG_OUT);
+        put_ri(jit, REG_ADDRESS, (pc + 1) & MAX_U15);
+        put(jit, 0x0F);
+        put(jit, static_cast<u8>(0x40u + get_condition(jump)));
+        put_modrm(jit, 3, REG_ADDRESS, REG_TARGET);
+    }
+    put_next(jit);
+}
+
+// NOTE: `enter(context, code)` saves the registers the generated code
+// takes over, loads them from `context` and jumps to `code`. `exit`, with
+// the next `pc` in `ecx`, puts everything back.
+static void put_trampoline(Jit* jit) {
+    static const u8 ENTER[] = {
+        0x53,                   // push rbx
+        0x55,                   // push rbp
+        0x41, 0x54,             // push r12
+        0x41, 0x55,             // push r13
+        0x41, 0x56,             // push r14
+        0x41, 0x57,             // push r15
+        0x49, 0x89, 0xFF,       // mov r15, rdi
+        0x4D, 0x8B, 0x27,       // mov r12, [r15]
+        0x4D, 0x8B, 0x6F, 0x08, // mov r13, [r15 + 8]
+        0x4D, 0x8B, 0x77, 0x10, // mov r14, [r15 + 16]
+        0x41, 0x8B, 0x5F, 0x18, // mov ebx, [r15 + 24]
+        0x41, 0x8B, 0x6F, 0x1C, // mov ebp, [r15 + 28]
+        0xFF, 0xE6,             // jmp rsi
+    };
+    static const u8 LEAVE[] = {
+        0x4D, 0x89, 0x77, 0x10, // mov [r15 + 16], r14
+        0x41, 0x89, 0x5F, 0x18, // mov [r15 + 24], ebx
+        0x41, 0x89, 0x6F, 0x1C, // mov [r15 + 28], ebp
+        0x41, 0x89, 0x4F, 0x20, // mov [r15 + 32], ecx
+        0x41, 0x5F,             // pop r15
+        0x41, 0x5E,             // pop r14
+        0x41, 0x5D,             // pop r13
+        0x41, 0x5C,             // pop r12
+        0x5D,                   // pop rbp
+        0x5B,                   // pop rbx
+        0xC3,                   // ret
+    };
+    jit->len_code = 0;
+    jit->enter = reinterpret_cast<Enter>(jit->code);
+    memcpy(jit->code, ENTER, sizeof(ENTER));
+    jit->len_code += sizeof(ENTER);
+    jit->exit = &jit->code[jit->len_code];
+    memcpy(&jit->code[jit->len_code], LEAVE, sizeof(LEAVE));
+    jit->len_code += sizeof(LEAVE);
+    jit->len_trampoline = jit->len_code;
+}
+
+// NOTE: The code is never writable and executable at once. Only the pages
+// a block is being compiled into are writable, and only until it is done.
+static bool protect(Jit* jit, usize begin, usize end, i32 protection) {
+    const usize page = static_cast<usize>(sysconf(_SC_PAGESIZE));
+    begin -= begin % page;
+    end = ((end + page - 1) / page) * page;
+    return mprotect(&jit->code[begin], end - begin, protection) == 0;
+}
+
+// NOTE: Returns `null` where there is nothing to compile for, nowhere to
+// put the code, or the kernel will not run code once written (say, under
+// SELinux `execmem` or PaX `MPROTECT`); the interpreter then runs
+// everything.
+static Jit* alloc_jit() {
+    Jit* jit = reinterpret_cast<Jit*>(alloc(sizeof(Jit)));
+    void* code = mmap(null,
+                      CAP_CODE,
+                      PROT_READ | PROT_WRITE,
+                      MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE,
+                      -1,
+                      0);
+    if (code == MAP_FAILED) {
+        munmap(jit, sizeof(Jit));
+        return null;
+    }
+    jit->code = reinterpret_cast<u8*>(code);
+    put_trampoline(jit);
+    jit->len_blocks = 0;
+    if (!protect(jit, 0, CAP_CODE, PROT_READ | PROT_EXEC)) {
+        munmap(code, CAP_CODE);
+        munmap(jit, sizeof(Jit));
+        return null;
+    }
+    return jit;
+}
+
+static void free_jit(Jit* jit) {
+    munmap(jit->code, CAP_CODE);
+    munmap(jit, sizeof(Jit));
+}
+
+// NOTE: Drops every compiled block, to start filling the code over again.
+static void flush(Jit* jit) {
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    for (u32 i = 0; i < CAP_ROM; ++i) {
+        jit->entries[i] = jit->exit;
+    }
+    jit->len_code = jit->len_trampoline;
+}
+
+static bool is_covered(const Block* block, u32 pc, u32 until) {
+    return (until - pc) < block->len;
+}
+
+static Block* get_block(Jit* jit, const Emulator* emulator, u32 pc) {
+    Block* block = &jit->blocks[pc];
+    if (block->code) {
+        return block;
+    }
+    if ((CAP_CODE - jit->len_code) < CAP_BLOCK_CODE) {
+        flush(jit);
+    }
+    u32 end = pc;
+    for (;;) {
+        const u32 word = emulator->rom[end++];
+        if ((((word & 0x8000u) != 0) && ((word & 0x7u) != JUMP_NULL)) ||
+            ((end % LEN_BLOCK) == 0))
+        {
+            break;
+        }
+    }
+    const usize start = jit->len_code;
+    EXIT_IF(!protect(jit,
+                     start,
+                     start + CAP_BLOCK_CODE,
+                     PROT_READ | PROT_WRITE));
+    block->code = &jit->code[start];
+    block->len = end - pc;
+    // NOTE: `cmp r14, len`, `jae body`, exit on `pc`, then `sub r14, len`.
+    put(jit, 0x49);
+    put(jit, 0x81);
+    put(jit, 0xFE);
+    put_u32(jit, block->len);
+    put(jit, 0x73);
+    put(jit, 0x0A);
+    put_exit(jit, pc);
+    put(jit, 0x49);
+    put(jit, 0x81);
+    put(jit, 0xEE);
+    put_u32(jit, block->len);
+    bool known = false;
+    u32  address = 0;
+    for (u32 i = pc; i < end; ++i) {
+        const u32 word = emulator->rom[i];
+        if ((word & 0x8000u) == 0) {
+            put_ri(jit, REG_A, word);
+            known = true;
+            address = word;
+        } else {
+            put_compute(jit, word, i, &known, address);
+        }
+    }
+    const u32 last = emulator->rom[end - 1];
+    if (((last & 0x8000u) == 0) || ((last & 0x7u) == JUMP_NULL)) {
+        put_goto(jit, end & MAX_U15);
+    }
+    EXIT_IF(CAP_BLOCK_CODE < (jit->len_code - start));
+    EXIT_IF(!protect(jit,
+                     start,
+                     start + CAP_BLOCK_CODE,
+                     PROT_READ | PROT_EXEC));
+    ++jit->len_blocks;
+    return block;
+}
+
+// NOTE: Runs like `emulate`, compiling each block the first time it is
+// entered. Blocks are chained in the generated code, so the dispatcher only
+// sees control when it leaves compiled code.
+static Halt run_jit(Jit* jit, Emulator* emulator, u64 len_cycles, u32 until) {
+    for (u32 i = 0; i < CAP_ROM; ++i) {
+        const Block* block = &jit->blocks[i];
+        jit->entries[i] = (block->code && !is_covered(block, i, until))
+                              ? block->code
+                              : jit->exit;
+    }
+    Context context;
+    context.ram = emulator->ram;
+    context.entries = jit->entries;
+    u64 left = len_cycles;
+    for (;;) {
+        const u32 pc = emulator->pc;
+        if (left == 0) {
+            return HALT_CYCLES;
+        }
+        if (pc == until) {
+            return HALT_PC;
+        }
+        Block* block = get_block(jit, emulator, pc);
+        if (is_covered(block, pc, until) || (left < block->len)) {
+            return emulate(emulator, left, until);
+        }
+        jit->entries[pc] = block->code;
+        context.left = left;
+        context.a = emulator->a;
+        context.d = emulator->d;
+        jit->enter(&context, block->code);
+        emulator->cycles += left - context.left;
+        left = context.left;
+        emulator->a = static_cast<u16>(context.a);
+        emulator->d = static_cast<u16>(context.d);
+        emulator->pc = static_cast<u16>(context.pc);
+    }
+}
+
+#else
+
+struct Jit {
+    u32 len_blocks;
+};
+
+static Jit* alloc_jit() {
+    return null;
+}
+
+static void free_jit(Jit*) {
+}
+
+static Halt run_jit(Jit*, Emulator* emulator, u64 len_cycles, u32 until) {
+    return emulate(emulator, len_cycles, until);
+}
+
+#endif
+
+#endif
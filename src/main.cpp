@@ -1,17 +1,36 @@
+#include "emulator.hpp"
+#include "hack.hpp"
 #include "hash.hpp"
+#include "jit.hpp"
+#include "pool.hpp"
+#include "simd.hpp"
 
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
 
-#define MAX_U15     0x7FFF
 #define OFFSET_VARS 0x0010
 
-#define CAP_CHARS  (1 << 19)
-#define CAP_TOKENS (1 << 17)
-#define CAP_INSTS  MAX_U15
-#define CAP_LABELS 4513
-#define CAP_VARS   131
+#define CAP_INSTS   MAX_U15
+#define CAP_SYMBOLS (1 << 10)
+#define LOAD_MAPS   50
 
-STATIC_ASSERT(CAP_VARS <= (MAX_U15 - OFFSET_VARS));
+#define CAP_ARENA (1ul << 30)
+
+#define CAP_MAPPED (1ul << 28)
+#define CAP_CHUNK  (1u << 20)
+
+#define LEN_SEGMENT (1u << 16)
+#define LEN_SLICE   (1u << 12)
+
+#define LEN_LINE 17
+
+#define CAP_OUTPUT (CAP_INSTS * LEN_LINE)
 
 enum TokenTag {
     TOKEN_U15 = 0,
@@ -26,182 +45,355 @@ enum TokenTag {
     TOKEN_BANG,
     TOKEN_AMPERS,
     TOKEN_PIPE,
+    TOKEN_EOL,
+    TOKEN_EOF,
 };
 
 union TokenBody {
-    String as_string;
-    u16    as_u15;
+    u32 as_symbol;
+    u16 as_u15;
 };
 
 struct Token {
     TokenBody body;
     TokenTag  tag;
-    u32       offset;
+    u64       offset;
 };
 
-// clang-format off
-enum SymbolComp {
-    COMP_ZERO         = 0x2A,
-    COMP_ONE          = 0x3F,
-    COMP_NEGATIVE_ONE = 0x3A,
-    COMP_D            = 0x0C,
-    COMP_A            = 0x30,
-    COMP_M            = 0x70,
-    COMP_NOT_D        = 0x0D,
-    COMP_NOT_A        = 0x31,
-    COMP_NOT_M        = 0x71,
-    COMP_NEGATIVE_D   = 0x0F,
-    COMP_NEGATIVE_A   = 0x33,
-    COMP_NEGATIVE_M   = 0x73,
-    COMP_D_PLUS_1     = 0x1F,
-    COMP_A_PLUS_1     = 0x37,
-    COMP_M_PLUS_1     = 0x77,
-    COMP_D_MINUS_1    = 0x0E,
-    COMP_A_MINUS_1    = 0x32,
-    COMP_M_MINUS_1    = 0x72,
-    COMP_D_PLUS_A     = 0x02,
-    COMP_D_PLUS_M     = 0x42,
-    COMP_D_MINUS_A    = 0x13,
-    COMP_D_MINUS_M    = 0x53,
-    COMP_A_MINUS_D    = 0x07,
-    COMP_M_MINUS_D    = 0x47,
-    COMP_D_AND_A      = 0x00,
-    COMP_D_AND_M      = 0x40,
-    COMP_D_OR_A       = 0x15,
-    COMP_D_OR_M       = 0x55,
-};
-
-enum SymbolDest {
-    DEST_NULL = 0x00,
-    DEST_M    = 0x01,
-    DEST_D    = 0x02,
-    DEST_MD   = 0x03,
-    DEST_A    = 0x04,
-    DEST_AM   = 0x05,
-    DEST_AD   = 0x06,
-    DEST_AMD  = 0x07,
-};
-
-enum SymbolJump {
-    JUMP_NULL = 0x00,
-    JUMP_JGT  = 0x01,
-    JUMP_JEQ  = 0x02,
-    JUMP_JGE  = 0x03,
-    JUMP_JLT  = 0x04,
-    JUMP_JNE  = 0x05,
-    JUMP_JLE  = 0x06,
-    JUMP_JMP  = 0x07,
-};
-
-enum SymbolPreDef {
-    PREDEF_R0_SP   = 0x0000,
-    PREDEF_R1_LCL  = 0x0001,
-    PREDEF_R2_ARG  = 0x0002,
-    PREDEF_R3_THIS = 0x0003,
-    PREDEF_R4_THAT = 0x0004,
-    PREDEF_R5      = 0x0005,
-    PREDEF_R6      = 0x0006,
-    PREDEF_R7      = 0x0007,
-    PREDEF_R8      = 0x0008,
-    PREDEF_R9      = 0x0009,
-    PREDEF_R10     = 0x000A,
-    PREDEF_R11     = 0x000B,
-    PREDEF_R12     = 0x000C,
-    PREDEF_R13     = 0x000D,
-    PREDEF_R14     = 0x000E,
-    PREDEF_R15     = 0x000F,
-    PREDEF_SCREEN  = 0x4000,
-    PREDEF_KBD     = 0x6000,
-};
-
-static const char* BYTES[] = {
-    "0000", "0001", "0010", "0011", "0100", "0101", "0110", "0111", "1000",
-    "1001", "1010", "1011", "1100", "1101", "1110", "1111",
+// NOTE: The parser pulls tokens from the lexer on demand and never looks
+// more than one token past the current one, so `tokens` holds the current
+// token and the next; `i` is where lexing resumes in `Memory::chars`.
+// Token offsets are from the start of the input, not of `Memory::chars`.
+// `start` is where the instruction being parsed begins; nothing before it
+// can be reported anymore.
+struct Lexer {
+    Token    tokens[2];
+    u64      start;
+    u32      i;
+    u32      len_tokens;
+    TokenTag last;
 };
-// clang-format on
 
-enum InstTag {
-    INST_UNRESOLVED = 0,
-    INST_ADDRESS,
-    INST_COMPUTE,
+// NOTE: An `@symbol` that is not predefined is emitted as a placeholder word
+// and patched once every label is known.
+struct Fixup {
+    u32 symbol;
+    u16 inst;
+};
+
+enum Format {
+    FORMAT_HACK = 0,
+    FORMAT_BIN_LE,
+    FORMAT_BIN_BE,
+    FORMAT_IHEX,
+};
+
+enum RecordTag {
+    RECORD_DATA = 0x00,
+    RECORD_EOF  = 0x01,
+};
+
+#define LEN_RECORD 16u
+
+// NOTE: Lexing is fused into parsing, so `PHASE_PARSE` covers both. A
+// streamed input is mostly read during `PHASE_PARSE` too.
+enum Phase {
+    PHASE_READ = 0,
+    PHASE_PARSE,
+    PHASE_MERGE,
+    PHASE_RESOLVE,
+    PHASE_EMIT,
+};
+
+#define LEN_PHASES (PHASE_EMIT + 1)
+
+static const char* PHASES[LEN_PHASES] = {
+    "read",
+    "parse",
+    "merge",
+    "resolve",
+    "emit",
 };
 
-struct InstCompute {
-    SymbolComp comp;
-    SymbolDest dest;
-    SymbolJump jump;
+enum Report {
+    REPORT_NONE = 0,
+    REPORT_TEXT,
+    REPORT_JSON,
 };
 
-union InstBody {
-    String      as_string;
-    u16         as_u15;
-    InstCompute as_compute;
+// NOTE: Totals over every file a `Memory` has assembled; `times` are in
+// nanoseconds. `probes` counts symbol table groups probed.
+struct Stats {
+    u64 times[LEN_PHASES];
+    u64 len_files;
+    u64 len_bytes;
+    u64 len_tokens;
+    u64 len_insts;
+    u64 len_symbols;
+    u64 len_labels;
+    u64 len_vars;
+    u64 len_lookups;
+    u64 len_probes;
+    u32 max_probes;
 };
 
-struct Inst {
-    InstBody body;
-    InstTag  tag;
+enum SymbolTag {
+    SYMBOL_UNKNOWN = 0,
+    SYMBOL_PREDEF,
+    SYMBOL_LABEL,
+    SYMBOL_VAR,
+};
+
+// NOTE: Every distinct identifier is interned once, by the lexer, into
+// `Memory::symbols`; tokens and fixups refer to it by index from then on,
+// and its address is filled in as soon as it is known.
+struct Symbol {
+    Key       key;
+    u16       address;
+    SymbolTag tag;
+};
+
+// NOTE: `chars` is either the whole input, mapped, or (for pipes and very
+// large files) a window of at most `CAP_CHUNK` bytes that slides forward as
+// `file` is read. The window holds `len_read` bytes, starting at input
+// offset `offset_chars` after `len_lines` newlines; only the first
+// `len_chars` of them, which end on a line break unless the input is
+// exhausted, are ready to lex. The instruction being parsed leaves the
+// position of its start behind in `held` when it slides out of the window.
+// Instructions are stored already encoded.
+struct Held {
+    u64       offset;
+    Vec2<u64> position;
+};
+
+#define CAP_DIAGNOSTICS (1u << 7)
+#define LEN_REASON      (1u << 7)
+
+// NOTE: With `recover` set, a syntax error is filed here, and parsing picks
+// up again on the next line. `reason` is what the failure would have
+// printed after the position; a failure with no position ends the parse.
+struct Diagnostic {
+    u64       offset;
+    Vec2<u64> position;
+    char      reason[LEN_REASON];
 };
 
 struct Memory {
     const char*                    path;
-    char                           chars[CAP_CHARS];
-    Token                          tokens[CAP_TOKENS];
-    Inst                           insts[CAP_INSTS];
-    Table<String, u16, CAP_LABELS> labels;
-    Table<String, u16, CAP_VARS>   vars;
+    char*                          chars;
+    usize                          cap_chars;
+    i32                            file;
+    u64                            offset_chars;
+    u64                            len_lines;
+    Held                           held;
+    Lexer                          lexer;
+    u16                            insts[CAP_INSTS];
+    Fixup                          fixups[CAP_INSTS];
+    Arena                          arena;
+    Map<Key, u32>                  ids;
+    Symbol*                        symbols;
+    char                           output[CAP_OUTPUT];
     u32                            len_chars;
-    u32                            len_tokens;
+    u32                            len_read;
     u32                            len_insts;
+    u32                            len_fixups;
+    u32                            len_symbols;
+    u32                            cap_symbols;
+    u32                            len_labels;
+    u32                            len_vars;
+    u32                            len_output;
+    u32*                           line_starts;
+    u32                            len_line_starts;
+    u32                            cap_line_starts;
+    bool                           indexed;
+    Diagnostic*                    diagnostics;
+    u64                            offset_failed;
+    u32                            len_diagnostics;
+    u32                            len_chars_resumed;
+    u32                            resume;
+    bool                           recover;
+    bool                           recovering;
+    bool                           failed;
+    bool                           reparsing;
+    Stats                          stats;
 };
 
-#define EXIT_PRINT(memory, x)     \
-    {                             \
-        print(stderr, memory, x); \
-        EXIT();                   \
+#define EXIT_PRINT(memory, x) \
+    {                         \
+        report(memory, x);    \
+        EXIT();               \
     }
 
 #define EXIT_IF_PRINT(condition, memory, x) \
     {                                       \
         if (condition) {                    \
-            print(stderr, memory, x);       \
+            report(memory, x);              \
             EXIT_WITH(#condition);          \
         }                                   \
     }
 
-#define IS_ALPHA(x) \
-    ((('A' <= (x)) && ((x) <= 'Z')) || (('a' <= (x)) && ((x) <= 'z')))
+enum CharClass {
+    CHAR_INVALID = 0,
+    CHAR_SPACE,
+    CHAR_NEWLINE,
+    CHAR_SLASH,
+    CHAR_DIGIT,
+    CHAR_IDENT,
+    CHAR_TOKEN,
+};
+
+// NOTE: Each entry of `CHARS` packs a `CharClass` into the low three bits,
+// `CHAR_CONTINUE` for anything that may continue an identifier, and (for
+// `CHAR_TOKEN`) the punctuator's `TokenTag` into the high nibble.
+#define CHAR_MASK     0x07u
+#define CHAR_CONTINUE 0x08u
+#define CHAR_SHIFT    4u
 
-#define IS_DIGIT(x) (('0' <= (x)) && ((x) <= '9'))
+STATIC_ASSERT(TOKEN_EOF < (1u << (8u - CHAR_SHIFT)));
 
-#define IS_PUNCT(x) \
-    (((x) == '_') || ((x) == '.') || ((x) == '$') || ((x) == ':'))
+#define CHAR_TOKEN_WITH(tag) \
+    ((static_cast<u32>(tag) << CHAR_SHIFT) | static_cast<u32>(CHAR_TOKEN))
 
-#define IS_ALPHA_OR_DIGIT_OR_PUNCT(x) \
-    (IS_ALPHA(x) || IS_DIGIT(x) || IS_PUNCT(x))
+static constexpr u32 get_char_token(u32 x) {
+    return (x == '(')   ? CHAR_TOKEN_WITH(TOKEN_LPAREN)
+           : (x == ')') ? CHAR_TOKEN_WITH(TOKEN_RPAREN)
+           : (x == '@') ? CHAR_TOKEN_WITH(TOKEN_AT)
+           : (x == '=') ? CHAR_TOKEN_WITH(TOKEN_EQUALS)
+           : (x == ';') ? CHAR_TOKEN_WITH(TOKEN_SCOLON)
+           : (x == '+') ? CHAR_TOKEN_WITH(TOKEN_PLUS)
+           : (x == '-') ? CHAR_TOKEN_WITH(TOKEN_MINUS)
+           : (x == '!') ? CHAR_TOKEN_WITH(TOKEN_BANG)
+           : (x == '&') ? CHAR_TOKEN_WITH(TOKEN_AMPERS)
+           : (x == '|') ? CHAR_TOKEN_WITH(TOKEN_PIPE)
+                        : static_cast<u32>(CHAR_INVALID);
+}
 
-static Token* alloc_token(Memory* memory) {
-    EXIT_IF(CAP_TOKENS <= memory->len_tokens);
-    return &memory->tokens[memory->len_tokens++];
+static constexpr u8 get_char(u32 x) {
+    return static_cast<u8>(
+        ((x == ' ') || (x == '\t') || (x == '\r'))
+            ? static_cast<u32>(CHAR_SPACE)
+        : (x == '\n') ? static_cast<u32>(CHAR_NEWLINE)
+        : (x == '/')  ? static_cast<u32>(CHAR_SLASH)
+        : (('0' <= x) && (x <= '9'))
+            ? (static_cast<u32>(CHAR_DIGIT) | CHAR_CONTINUE)
+        : ((('A' <= x) && (x <= 'Z')) || (('a' <= x) && (x <= 'z')) ||
+           (x == '_') || (x == '.') || (x == '$') || (x == ':'))
+            ? (static_cast<u32>(CHAR_IDENT) | CHAR_CONTINUE)
+            : get_char_token(x));
 }
 
-static Inst* alloc_inst(Memory* memory) {
+static constexpr u8 CHARS[256] = {TABLE_256(get_char, 0u)};
+
+#define GET_CHAR(x) (CHARS[static_cast<u8>(x)])
+
+#define IS_SPACE(x) ((GET_CHAR(x) & CHAR_MASK) == CHAR_SPACE)
+
+#define IS_BLANK(x) (IS_SPACE(x) || ((x) == '\n'))
+
+#define IS_DIGIT(x) ((GET_CHAR(x) & CHAR_MASK) == CHAR_DIGIT)
+
+#define IS_CONTINUE(x) ((GET_CHAR(x) & CHAR_CONTINUE) != 0)
+
+static u16* alloc_inst(Memory* memory) {
     EXIT_IF(CAP_INSTS <= memory->len_insts);
     return &memory->insts[memory->len_insts++];
 }
 
+static Fixup* alloc_fixup(Memory* memory) {
+    EXIT_IF(CAP_INSTS <= memory->len_fixups);
+    return &memory->fixups[memory->len_fixups++];
+}
+
+static Symbol* alloc_symbol(Memory* memory) {
+    if (memory->len_symbols == memory->cap_symbols) {
+        EXIT_IF((UINT32_MAX >> 1) < memory->cap_symbols);
+        Symbol* symbols =
+            alloc<Symbol>(&memory->arena, memory->cap_symbols << 1);
+        memcpy(symbols,
+               memory->symbols,
+               sizeof(Symbol) * memory->len_symbols);
+        memory->symbols = symbols;
+        memory->cap_symbols <<= 1;
+    }
+    return &memory->symbols[memory->len_symbols++];
+}
+
+static u64 get_time() {
+    struct timespec time;
+    EXIT_IF(clock_gettime(CLOCK_MONOTONIC, &time) != 0);
+    return (static_cast<u64>(time.tv_sec) * 1000000000ull) +
+           static_cast<u64>(time.tv_nsec);
+}
+
+// NOTE: Charges the time since `start` to `phase` and returns the time now,
+// to start the next phase from.
+static u64 lap(Stats* stats, Phase phase, u64 start) {
+    const u64 now = get_time();
+    stats->times[phase] += now - start;
+    return now;
+}
+
 static void set_chars_from_file(Memory* memory, const char* path) {
-    File* file = fopen(path, "r");
-    EXIT_IF(!file);
-    fseek(file, 0, SEEK_END);
-    memory->len_chars = static_cast<u32>(ftell(file));
-    EXIT_IF(CAP_CHARS <= (memory->len_chars + 1));
-    rewind(file);
-    EXIT_IF(fread(memory->chars, sizeof(char), memory->len_chars, file) !=
-            memory->len_chars);
-    fclose(file);
-    memory->chars[memory->len_chars] = '\0';
+    const i32 file = open(path, O_RDONLY);
+    EXIT_IF(file < 0);
+    struct stat info;
+    EXIT_IF(fstat(file, &info) < 0);
+    memory->path = path;
+    memory->offset_chars = 0;
+    memory->len_lines = 0;
+    memory->held.offset = 0;
+    memory->indexed = false;
+    if (!S_ISREG(info.st_mode) ||
+        (CAP_MAPPED < static_cast<usize>(info.st_size)))
+    {
+        // NOTE: Start with an empty window; the lexer pulls in the first
+        // chunk when it runs out of characters.
+        memory->cap_chars = CAP_CHUNK + SIMD_PAD;
+        memory->chars = reinterpret_cast<char*>(alloc(memory->cap_chars));
+        memory->file = file;
+        memory->len_chars = 0;
+        memory->len_read = 0;
+        return;
+    }
+    memory->len_chars = static_cast<u32>(info.st_size);
+    memory->len_read = memory->len_chars;
+    // NOTE: Reserve enough zeroed pages to hold the file plus `SIMD_PAD`
+    // trailing bytes, then map the file over the front of the reservation.
+    // Whatever lies past `len_chars` reads as '\0', so the lexer keeps its
+    // terminator (and may load whole vectors off the end) without copying
+    // the source anywhere.
+    const usize page = static_cast<usize>(sysconf(_SC_PAGESIZE));
+    memory->cap_chars = (((memory->len_chars + SIMD_PAD) / page) + 1) * page;
+    char* chars = reinterpret_cast<char*>(alloc(memory->cap_chars));
+    if (memory->len_chars != 0) {
+        EXIT_IF(mmap(chars,
+                     memory->len_chars,
+                     PROT_READ,
+                     MAP_FIXED | MAP_PRIVATE | MAP_POPULATE,
+                     file,
+                     0) == MAP_FAILED);
+    }
+    close(file);
+    memory->chars = chars;
+    memory->file = -1;
+}
+
+// NOTE: Lex `len` bytes already in memory; `chars` must be followed by
+// `SIMD_PAD` zeroed bytes.
+static void set_chars(Memory* memory, const char* path, char* chars, u32 len) {
     memory->path = path;
+    memory->chars = chars;
+    memory->file = -1;
+    memory->offset_chars = 0;
+    memory->len_lines = 0;
+    memory->held.offset = 0;
+    memory->indexed = false;
+    memory->len_chars = len;
+    memory->len_read = len;
+}
+
+static void unset_chars(Memory* memory) {
+    EXIT_IF(munmap(memory->chars, memory->cap_chars) != 0);
 }
 
 static bool set_digits(const char* chars, u32* i, u16* a) {
@@ -216,212 +408,428 @@ static bool set_digits(const char* chars, u32* i, u16* a) {
     return true;
 }
 
-static void print(File* stream, Memory* memory, u32 offset) {
-    Vec2<u32> position = {1, 1};
-    EXIT_IF(memory->len_chars <= offset);
-    for (u32 i = 0; i < offset; ++i) {
-        if (memory->chars[i] == '\n') {
-            ++position.y;
-            position.x = 1;
-        } else {
-            ++position.x;
+// NOTE: The scans below lean on the '\0' sentinel past `len_chars`, which is
+// neither whitespace nor part of an identifier.
+static u32 skip_space(const char* chars, u32 i) {
+#ifdef SIMD_WIDTH
+    for (;; i += SIMD_WIDTH) {
+        const Bytes bytes = load(&chars[i]);
+        const Bytes space =
+            bit_or(bit_or(eq(bytes, splat(' ')), eq(bytes, splat('\t'))),
+                   eq(bytes, splat('\r')));
+        const u32   mask = to_mask(space) ^ SIMD_ALL;
+        if (mask != 0) {
+            return i + static_cast<u32>(__builtin_ctz(mask));
         }
     }
-    fprintf(stream, "%s:%u:%u\n", memory->path, position.y, position.x);
-}
-
-template <TokenTag X>
-static void set_token_with(Memory* memory, u32* i) {
-    Token* token = alloc_token(memory);
-    token->tag = X;
-    token->offset = *i;
-    ++(*i);
+#else
+    while (IS_SPACE(chars[i])) {
+        ++i;
+    }
+    return i;
+#endif
 }
 
-static void set_tokens(Memory* memory) {
-    memory->len_tokens = 0;
-    for (u32 i = 0; i < memory->len_chars;) {
-        switch (memory->chars[i]) {
-        case '/': {
-            ++i;
-            EXIT_IF_PRINT(memory->len_chars <= i,
-                          memory,
-                          memory->len_chars - 1);
-            EXIT_IF_PRINT(memory->chars[i] != '/', memory, i);
-            for (; i < memory->len_chars; ++i) {
-                if (memory->chars[i] == '\n') {
-                    break;
-                }
-            }
-            break;
+static u32 find_newline(const char* chars, u32 i, u32 len) {
+#ifdef SIMD_WIDTH
+    for (; i < len; i += SIMD_WIDTH) {
+        const u32 mask = to_mask(eq(load(&chars[i]), splat('\n')));
+        if (mask != 0) {
+            return i + static_cast<u32>(__builtin_ctz(mask));
         }
-        case ' ':
-        case '\t':
-        case '\r':
-        case '\n': {
-            ++i;
+    }
+    return len;
+#else
+    for (; i < len; ++i) {
+        if (chars[i] == '\n') {
             break;
         }
-        case '(': {
-            set_token_with<TOKEN_LPAREN>(memory, &i);
-            break;
+    }
+    return i;
+#endif
+}
+
+static u32 skip_ident(const char* chars, u32 i) {
+#ifdef SIMD_WIDTH
+    for (;; i += SIMD_WIDTH) {
+        const Bytes bytes = load(&chars[i]);
+        const Bytes alpha_or_digit =
+            bit_or(in_range(bit_or(bytes, splat(0x20)), 'a', 'z'),
+                   in_range(bytes, '0', '9'));
+        const Bytes punct =
+            bit_or(bit_or(eq(bytes, splat('_')), eq(bytes, splat('.'))),
+                   bit_or(eq(bytes, splat('$')), eq(bytes, splat(':'))));
+        const u32   mask = to_mask(bit_or(alpha_or_digit, punct)) ^ SIMD_ALL;
+        if (mask != 0) {
+            return i + static_cast<u32>(__builtin_ctz(mask));
         }
-        case ')': {
-            set_token_with<TOKEN_RPAREN>(memory, &i);
-            break;
+    }
+#else
+    while (IS_CONTINUE(chars[i])) {
+        ++i;
+    }
+    return i;
+#endif
+}
+
+// NOTE: Switching on the length and then the leading characters narrows the
+// predefined symbols down to at most one candidate, so a miss (every user
+// variable) costs a couple of branches and at most one final compare.
+static bool set_predef(String string, u16* address) {
+    const char* chars = string.chars;
+    switch (string.len) {
+    case 2: {
+        if ((chars[0] == 'R') && IS_DIGIT(chars[1])) {
+            *address = static_cast<u16>(PREDEF_R0_SP + (chars[1] - '0'));
+            return true;
         }
-        case '@': {
-            set_token_with<TOKEN_AT>(memory, &i);
-            break;
+        if ((chars[0] == 'S') && (chars[1] == 'P')) {
+            *address = PREDEF_R0_SP;
+            return true;
         }
-        case '=': {
-            set_token_with<TOKEN_EQUALS>(memory, &i);
-            break;
+        return false;
+    }
+    case 3: {
+        switch (chars[0]) {
+        case 'R': {
+            if ((chars[1] == '1') && ('0' <= chars[2]) && (chars[2] <= '5')) {
+                *address = static_cast<u16>(PREDEF_R10 + (chars[2] - '0'));
+                return true;
+            }
+            return false;
         }
-        case ';': {
-            set_token_with<TOKEN_SCOLON>(memory, &i);
-            break;
+        case 'L': {
+            *address = PREDEF_R1_LCL;
+            return string == TO_STR("LCL");
         }
-        case '+': {
-            set_token_with<TOKEN_PLUS>(memory, &i);
-            break;
+        case 'A': {
+            *address = PREDEF_R2_ARG;
+            return string == TO_STR("ARG");
         }
-        case '-': {
-            set_token_with<TOKEN_MINUS>(memory, &i);
-            break;
+        case 'K': {
+            *address = PREDEF_KBD;
+            return string == TO_STR("KBD");
         }
-        case '!': {
-            set_token_with<TOKEN_BANG>(memory, &i);
-            break;
+        default: {
+            return false;
         }
-        case '&': {
-            set_token_with<TOKEN_AMPERS>(memory, &i);
-            break;
         }
-        case '|': {
-            set_token_with<TOKEN_PIPE>(memory, &i);
-            break;
+    }
+    case 4: {
+        switch (chars[2]) {
+        case 'I': {
+            *address = PREDEF_R3_THIS;
+            return string == TO_STR("THIS");
+        }
+        case 'A': {
+            *address = PREDEF_R4_THAT;
+            return string == TO_STR("THAT");
         }
         default: {
-            EXIT_IF_PRINT(!(IS_ALPHA_OR_DIGIT_OR_PUNCT(memory->chars[i])),
-                          memory,
-                          i);
-            Token* token = alloc_token(memory);
-            token->offset = i;
-            if (IS_DIGIT(memory->chars[i])) {
-                u32 j = i;
-                if (!set_digits(memory->chars, &i, &token->body.as_u15) ||
-                    (MAX_U15 < token->body.as_u15))
-                {
-                    EXIT_PRINT(memory, j);
-                }
-                token->tag = TOKEN_U15;
-                continue;
-            }
-            u32 j = i;
-            for (; j < memory->len_chars; ++j) {
-                if (!(IS_ALPHA_OR_DIGIT_OR_PUNCT(memory->chars[j]))) {
-                    break;
-                }
-            }
-            EXIT_IF_PRINT(i == j, memory, i);
-            token->body.as_string = (String){&memory->chars[i], j - i};
-            token->tag = TOKEN_STR;
-            i = j;
+            return false;
         }
         }
     }
-}
-
-template <SymbolPreDef X>
-static Inst* get_predef_with(Memory* memory) {
-    Inst* inst = alloc_inst(memory);
-    inst->tag = INST_ADDRESS;
-    inst->body.as_u15 = static_cast<u16>(X);
-    return inst;
-}
-
-static Inst* get_predef(Memory* memory, String string) {
-    if ((string == TO_STR("R0")) || (string == TO_STR("SP"))) {
-        return get_predef_with<PREDEF_R0_SP>(memory);
-    }
-    if ((string == TO_STR("R1")) || (string == TO_STR("LCL"))) {
-        return get_predef_with<PREDEF_R1_LCL>(memory);
+    case 6: {
+        *address = PREDEF_SCREEN;
+        return string == TO_STR("SCREEN");
     }
-    if ((string == TO_STR("R2")) || (string == TO_STR("ARG"))) {
-        return get_predef_with<PREDEF_R2_ARG>(memory);
-    }
-    if ((string == TO_STR("R3")) || (string == TO_STR("THIS"))) {
-        return get_predef_with<PREDEF_R3_THIS>(memory);
+    default: {
+        return false;
     }
-    if ((string == TO_STR("R4")) || (string == TO_STR("THAT"))) {
-        return get_predef_with<PREDEF_R4_THAT>(memory);
     }
-    if (string == TO_STR("R5")) {
-        return get_predef_with<PREDEF_R5>(memory);
+}
+
+static u32 intern(Memory* memory, Key key) {
+    const u32* id = lookup(&memory->ids, key);
+    if (id) {
+        return *id;
     }
-    if (string == TO_STR("R6")) {
-        return get_predef_with<PREDEF_R6>(memory);
+    // NOTE: A streamed window is overwritten as the input moves on, so the
+    // symbol keeps its own copy of the name.
+    char* chars = alloc<char>(&memory->arena, key.len);
+    memcpy(chars, key.chars, key.len);
+    key.chars = chars;
+    const u32 new_id = memory->len_symbols;
+    Symbol*   symbol = alloc_symbol(memory);
+    symbol->key = key;
+    symbol->tag = set_predef((String){key.chars, key.len}, &symbol->address)
+                      ? SYMBOL_PREDEF
+                      : SYMBOL_UNKNOWN;
+    insert(&memory->ids, key, new_id);
+    return new_id;
+}
+
+static Token set_lexer(Lexer* lexer, Token token, u32 i) {
+    ++lexer->len_tokens;
+    lexer->i = i;
+    lexer->last = token.tag;
+    return token;
+}
+
+static u32 count_newlines(const char* chars, u32 len) {
+    u32 n = 0;
+    for (u32 i = find_newline(chars, 0, len); i < len;
+         i = find_newline(chars, i + 1, len))
+    {
+        ++n;
     }
-    if (string == TO_STR("R7")) {
-        return get_predef_with<PREDEF_R7>(memory);
+    return n;
+}
+
+// NOTE: Diagnostics look lines up in an index of where each line of the
+// window starts, built on first use and dropped whenever the window moves.
+static void set_line_starts(Memory* memory) {
+    const char* chars = memory->chars;
+    const u32   len = memory->len_read;
+    const u32   len_line_starts = count_newlines(chars, len) + 1;
+    if (memory->cap_line_starts < len_line_starts) {
+        memory->cap_line_starts =
+            (len_line_starts < (memory->cap_line_starts * 2))
+                ? memory->cap_line_starts * 2
+                : len_line_starts;
+        memory->line_starts =
+            alloc<u32>(&memory->arena, memory->cap_line_starts);
     }
-    if (string == TO_STR("R8")) {
-        return get_predef_with<PREDEF_R8>(memory);
+    memory->line_starts[0] = 0;
+    u32 j = 1;
+    for (u32 i = find_newline(chars, 0, len); i < len;
+         i = find_newline(chars, i + 1, len))
+    {
+        memory->line_starts[j++] = i + 1;
     }
-    if (string == TO_STR("R9")) {
-        return get_predef_with<PREDEF_R9>(memory);
+    memory->len_line_starts = len_line_starts;
+    memory->indexed = true;
+}
+
+// NOTE: The window always starts at the beginning of a line.
+static Vec2<u64> get_position(Memory* memory, u64 offset) {
+    EXIT_IF((offset < memory->offset_chars) ||
+            ((memory->offset_chars + memory->len_read) <= offset));
+    if (!memory->indexed) {
+        set_line_starts(memory);
     }
-    if (string == TO_STR("R10")) {
-        return get_predef_with<PREDEF_R10>(memory);
+    const u32* line_starts = memory->line_starts;
+    const u32  i = static_cast<u32>(offset - memory->offset_chars);
+    u32        lo = 0;
+    u32        hi = memory->len_line_starts;
+    while (1 < (hi - lo)) {
+        const u32 mid = lo + ((hi - lo) / 2);
+        if (line_starts[mid] <= i) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
     }
-    if (string == TO_STR("R11")) {
-        return get_predef_with<PREDEF_R11>(memory);
+    return (Vec2<u64>){i - line_starts[lo] + 1, memory->len_lines + lo + 1};
+}
+
+// NOTE: An instruction never spans a line break, so anything behind the
+// window that can still be reported is on the line of its start.
+static Vec2<u64> locate(Memory* memory, u64 offset) {
+    if (memory->offset_chars <= offset) {
+        return get_position(memory, offset);
     }
-    if (string == TO_STR("R12")) {
-        return get_predef_with<PREDEF_R12>(memory);
+    const Held held = memory->held;
+    EXIT_IF(offset < held.offset);
+    return (Vec2<u64>){held.position.x + (offset - held.offset),
+                       held.position.y};
+}
+
+static void print(File* stream, const char* path, Vec2<u64> position) {
+    fprintf(stream,
+            "%s:%" PRIu64 ":%" PRIu64 "\n",
+            path,
+            position.y,
+            position.x);
+}
+
+// NOTE: While recovering, the offset is kept for `set_insts` to file along
+// with the reason printed right after it.
+static void report(Memory* memory, u64 offset) {
+    if (memory->recovering) {
+        memory->offset_failed = offset;
+        memory->failed = true;
+        return;
     }
-    if (string == TO_STR("R13")) {
-        return get_predef_with<PREDEF_R13>(memory);
+    print(ERRORS, memory->path, locate(memory, offset));
+}
+
+static u32 find_line_start(const char* chars, u32 i) {
+    while ((i != 0) && (chars[i - 1] != '\n')) {
+        --i;
     }
-    if (string == TO_STR("R14")) {
-        return get_predef_with<PREDEF_R14>(memory);
+    return i;
+}
+
+// NOTE: Slide the window up to the line the lexer is on and read
+// until it holds at least one more complete line (or the rest of the
+// input). Whatever follows the last '\n' stays unlexed until the next
+// refill, so no token is ever split across two reads. Returns `false` once
+// there is nothing left to lex.
+static bool refill(Memory* memory) {
+    if (memory->file < 0) {
+        return false;
     }
-    if (string == TO_STR("R15")) {
-        return get_predef_with<PREDEF_R15>(memory);
+    Lexer*    lexer = &memory->lexer;
+    char*     chars = memory->chars;
+    const u32 keep = find_line_start(chars, lexer->i);
+    // NOTE: The instruction being parsed may be about to leave the window
+    // (say, ending in the `TOKEN_EOL` before a long run of comments) while
+    // it can still be reported.
+    const u64 offset = lexer->start;
+    if ((memory->offset_chars <= offset) &&
+        (offset < (memory->offset_chars + keep)))
+    {
+        memory->held.offset = offset;
+        memory->held.position = get_position(memory, offset);
     }
-    if (string == TO_STR("SCREEN")) {
-        return get_predef_with<PREDEF_SCREEN>(memory);
+    memory->len_lines += count_newlines(chars, keep);
+    memory->indexed = false;
+    memmove(chars, &chars[keep], memory->len_read - keep);
+    memory->offset_chars += keep;
+    memory->len_read -= keep;
+    lexer->i -= keep;
+    for (;;) {
+        // NOTE: A window without a single line break is a line that does
+        // not fit.
+        EXIT_IF(CAP_CHUNK <= memory->len_read);
+        const ssize_t n = read(memory->file,
+                               &chars[memory->len_read],
+                               CAP_CHUNK - memory->len_read);
+        EXIT_IF(n < 0);
+        if (n == 0) {
+            close(memory->file);
+            memory->file = -1;
+            memset(&chars[memory->len_read], 0, SIMD_PAD);
+            memory->len_chars = memory->len_read;
+            return lexer->i < memory->len_chars;
+        }
+        const u32 start = memory->len_read;
+        memory->len_read += static_cast<u32>(n);
+        for (u32 i = memory->len_read; start < i; --i) {
+            if (chars[i - 1] == '\n') {
+                memory->len_chars = i;
+                return true;
+            }
+        }
     }
-    if (string == TO_STR("KBD")) {
-        return get_predef_with<PREDEF_KBD>(memory);
+}
+
+static Token lex(Memory* memory) {
+    Lexer* lexer = &memory->lexer;
+    for (u32 i = lexer->i;;) {
+        if (memory->len_chars <= i) {
+            lexer->i = i;
+            if (!refill(memory)) {
+                break;
+            }
+            i = lexer->i;
+        }
+        const char* chars = memory->chars;
+        const u64   offset = memory->offset_chars + i;
+        const u8    x = GET_CHAR(chars[i]);
+        switch (x & CHAR_MASK) {
+        case CHAR_SLASH: {
+            ++i;
+            EXIT_IF_PRINT(memory->len_chars <= i, memory, offset);
+            EXIT_IF_PRINT(chars[i] != '/', memory, offset + 1);
+            i = find_newline(chars, i, memory->len_chars);
+            break;
+        }
+        case CHAR_SPACE: {
+            i = skip_space(chars, i + 1);
+            break;
+        }
+        case CHAR_NEWLINE: {
+            // NOTE: Blank and comment-only lines collapse into the previous
+            // `TOKEN_EOL`.
+            if (lexer->last != TOKEN_EOL) {
+                return set_lexer(lexer,
+                                 (Token){{0}, TOKEN_EOL, offset},
+                                 i + 1);
+            }
+            ++i;
+            break;
+        }
+        case CHAR_TOKEN: {
+            return set_lexer(
+                lexer,
+                (Token){{0}, static_cast<TokenTag>(x >> CHAR_SHIFT), offset},
+                i + 1);
+        }
+        case CHAR_DIGIT: {
+            Token token = {{0}, TOKEN_U15, offset};
+            if (!set_digits(chars, &i, &token.body.as_u15) ||
+                (MAX_U15 < token.body.as_u15))
+            {
+                EXIT_PRINT(memory, token.offset);
+            }
+            return set_lexer(lexer, token, i);
+        }
+        case CHAR_IDENT: {
+            const u32 j = skip_ident(chars, i);
+            Token     token = {{0}, TOKEN_STR, offset};
+            token.body.as_symbol =
+                intern(memory, to_key((String){&chars[i], j - i}));
+            return set_lexer(lexer, token, j);
+        }
+        case CHAR_INVALID:
+        default: {
+            EXIT_PRINT(memory, offset);
+        }
+        }
     }
-    return null;
+    // NOTE: `TOKEN_EOF` points at the last character, if any, so running
+    // out of input mid-instruction is reported on the line it happened.
+    return set_lexer(lexer,
+                     (Token){{0},
+                             TOKEN_EOF,
+                             memory->offset_chars + memory->len_chars -
+                                 (memory->len_chars != 0)},
+                     memory->len_chars);
+}
+
+static void init_lexer(Memory* memory, u32 i) {
+    Lexer* lexer = &memory->lexer;
+    lexer->i = i;
+    lexer->len_tokens = 0;
+    lexer->start = i;
+    // NOTE: Leading blank lines emit nothing.
+    lexer->last = TOKEN_EOL;
+    lexer->tokens[0] = lex(memory);
+    lexer->tokens[1] = lex(memory);
+}
+
+static Token peek_token(Memory* memory, u32 ahead) {
+    return memory->lexer.tokens[ahead];
 }
 
-static Token get_token(Memory* memory, u32 i) {
-    EXIT_IF_PRINT(memory->len_tokens <= i,
-                  memory,
-                  memory->tokens[memory->len_tokens - 1].offset);
-    return memory->tokens[i];
+static Token next_token(Memory* memory) {
+    Lexer*      lexer = &memory->lexer;
+    const Token token = lexer->tokens[0];
+    lexer->tokens[0] = lexer->tokens[1];
+    lexer->tokens[1] = lex(memory);
+    return token;
 }
 
-static void parse_address(Memory* memory, u32* i) {
-    const Token token = get_token(memory, (*i)++);
+static void parse_address(Memory* memory) {
+    const Token token = next_token(memory);
     switch (token.tag) {
     case TOKEN_U15: {
-        Inst* inst = alloc_inst(memory);
-        inst->tag = INST_ADDRESS;
-        inst->body.as_u15 = token.body.as_u15;
+        *alloc_inst(memory) = token.body.as_u15;
         break;
     }
     case TOKEN_STR: {
-        if (get_predef(memory, token.body.as_string)) {
-            return;
+        const Symbol symbol = memory->symbols[token.body.as_symbol];
+        if (symbol.tag == SYMBOL_PREDEF) {
+            *alloc_inst(memory) = symbol.address;
+        } else {
+            Fixup* fixup = alloc_fixup(memory);
+            fixup->symbol = token.body.as_symbol;
+            fixup->inst = static_cast<u16>(memory->len_insts);
+            *alloc_inst(memory) = 0;
         }
-        Inst* inst = alloc_inst(memory);
-        inst->tag = INST_UNRESOLVED;
-        inst->body.as_string = token.body.as_string;
         break;
     }
     case TOKEN_LPAREN:
@@ -434,491 +842,1984 @@ static void parse_address(Memory* memory, u32* i) {
     case TOKEN_BANG:
     case TOKEN_AMPERS:
     case TOKEN_PIPE:
+    case TOKEN_EOL:
+    case TOKEN_EOF:
     default: {
         EXIT_PRINT(memory, token.offset);
     }
     }
 }
 
-static SymbolDest get_dest(Memory* memory, u32* i) {
-    u8 dest = 0;
-    for (u32 j = *i; j < memory->len_tokens; ++j) {
-        const Token token = get_token(memory, j);
-        if (token.tag == TOKEN_STR) {
-            for (u32 k = 0; k < token.body.as_string.len; ++k) {
-                u8 bit;
-                switch (token.body.as_string.chars[k]) {
-                case 'M': {
-                    bit = static_cast<u8>(DEST_M);
-                    break;
-                }
-                case 'D': {
-                    bit = static_cast<u8>(DEST_D);
-                    break;
-                }
-                case 'A': {
-                    bit = static_cast<u8>(DEST_A);
-                    break;
-                }
-                default: {
-                    EXIT_PRINT(memory, token.offset);
-                }
-                }
-                if (0 < (dest & bit)) {
-                    EXIT_PRINT(memory, token.offset);
-                }
-                dest |= bit;
-            }
-        } else if (token.tag == TOKEN_EQUALS) {
-            *i = j;
-            break;
-        } else {
+enum Atom {
+    ATOM_NONE = 0,
+    ATOM_ZERO,
+    ATOM_ONE,
+    ATOM_D,
+    ATOM_A,
+    ATOM_M,
+    ATOM_MINUS,
+    ATOM_BANG,
+    ATOM_PLUS,
+    ATOM_AMPERS,
+    ATOM_PIPE,
+    ATOM_INVALID,
+};
+
+// NOTE: A comp field is at most three atoms, each packed into `ATOM_BITS`
+// bits of a key that indexes `COMPS` directly.
+#define ATOM_BITS 4u
+#define CAP_ATOMS 3u
+
+STATIC_ASSERT(ATOM_INVALID < (1u << ATOM_BITS));
+
+#define COMP_KEY(a, b, c)                           \
+    (static_cast<u32>(ATOM_##a) |                   \
+     (static_cast<u32>(ATOM_##b) << ATOM_BITS) |    \
+     (static_cast<u32>(ATOM_##c) << (ATOM_BITS * 2u)))
+
+#define COMP_IF(a, b, c, comp) \
+    (key == COMP_KEY(a, b, c)) ? static_cast<u32>(comp):
+
+// clang-format off
+static constexpr u8 get_comp_of(u32 key) {
+    return static_cast<u8>(
+        COMP_IF(ZERO,  NONE,   NONE, COMP_ZERO)
+        COMP_IF(ONE,   NONE,   NONE, COMP_ONE)
+        COMP_IF(MINUS, ONE,    NONE, COMP_NEGATIVE_ONE)
+        COMP_IF(D,     NONE,   NONE, COMP_D)
+        COMP_IF(A,     NONE,   NONE, COMP_A)
+        COMP_IF(M,     NONE,   NONE, COMP_M)
+        COMP_IF(BANG,  D,      NONE, COMP_NOT_D)
+        COMP_IF(BANG,  A,      NONE, COMP_NOT_A)
+        COMP_IF(BANG,  M,      NONE, COMP_NOT_M)
+        COMP_IF(MINUS, D,      NONE, COMP_NEGATIVE_D)
+        COMP_IF(MINUS, A,      NONE, COMP_NEGATIVE_A)
+        COMP_IF(MINUS, M,      NONE, COMP_NEGATIVE_M)
+        COMP_IF(D,     PLUS,   ONE,  COMP_D_PLUS_1)
+        COMP_IF(A,     PLUS,   ONE,  COMP_A_PLUS_1)
+        COMP_IF(M,     PLUS,   ONE,  COMP_M_PLUS_1)
+        COMP_IF(D,     MINUS,  ONE,  COMP_D_MINUS_1)
+        COMP_IF(A,     MINUS,  ONE,  COMP_A_MINUS_1)
+        COMP_IF(M,     MINUS,  ONE,  COMP_M_MINUS_1)
+        COMP_IF(D,     PLUS,   A,    COMP_D_PLUS_A)
+        COMP_IF(D,     PLUS,   M,    COMP_D_PLUS_M)
+        COMP_IF(D,     MINUS,  A,    COMP_D_MINUS_A)
+        COMP_IF(D,     MINUS,  M,    COMP_D_MINUS_M)
+        COMP_IF(A,     MINUS,  D,    COMP_A_MINUS_D)
+        COMP_IF(M,     MINUS,  D,    COMP_M_MINUS_D)
+        COMP_IF(D,     AMPERS, A,    COMP_D_AND_A)
+        COMP_IF(D,     AMPERS, M,    COMP_D_AND_M)
+        COMP_IF(D,     PIPE,   A,    COMP_D_OR_A)
+        COMP_IF(D,     PIPE,   M,    COMP_D_OR_M)
+        COMP_INVALID);
+}
+// clang-format on
+
+static constexpr u8 COMPS[1u << (ATOM_BITS * CAP_ATOMS)] = {
+    TABLE_4096(get_comp_of, 0u),
+};
+
+static constexpr u8 get_dest_of(u32 x) {
+    return static_cast<u8>((x == 'M')   ? static_cast<u32>(DEST_M)
+                           : (x == 'D') ? static_cast<u32>(DEST_D)
+                           : (x == 'A') ? static_cast<u32>(DEST_A)
+                                        : static_cast<u32>(DEST_NULL));
+}
+
+static constexpr u8 DESTS[256] = {TABLE_256(get_dest_of, 0u)};
+
+// NOTE: The sum of the two letters after the 'J' is distinct (mod 16) for
+// every jump mnemonic, so `JUMP_HASH` is a perfect hash into `JUMPS`.
+#define JUMP_HASH(b, c) \
+    ((static_cast<u32>(static_cast<u8>(b)) + static_cast<u8>(c)) & 0xFu)
+
+#define JUMP_KEY(a, b, c)                           \
+    (static_cast<u32>(static_cast<u8>(a)) |         \
+     (static_cast<u32>(static_cast<u8>(b)) << 8u) | \
+     (static_cast<u32>(static_cast<u8>(c)) << 16u))
+
+#define JUMP_IF(b, c, jump) \
+    (hash == JUMP_HASH(b, c)) ? ((JUMP_KEY('J', b, c) << 8u) | (jump)):
+
+// clang-format off
+static constexpr u32 get_jump_of(u32 hash) {
+    return JUMP_IF('G', 'T', JUMP_JGT)
+           JUMP_IF('E', 'Q', JUMP_JEQ)
+           JUMP_IF('G', 'E', JUMP_JGE)
+           JUMP_IF('L', 'T', JUMP_JLT)
+           JUMP_IF('N', 'E', JUMP_JNE)
+           JUMP_IF('L', 'E', JUMP_JLE)
+           JUMP_IF('M', 'P', JUMP_JMP)
+           0u;
+}
+// clang-format on
+
+// NOTE: Each entry holds the mnemonic's three bytes above its `SymbolJump`.
+static constexpr u32 JUMPS[16] = {TABLE_16(get_jump_of, 0u)};
+
+#define JUMP_CHECK(b, c, jump) \
+    STATIC_ASSERT(JUMPS[JUMP_HASH(b, c)] ==   \
+                  ((JUMP_KEY('J', b, c) << 8u) | (jump)))
+
+JUMP_CHECK('G', 'T', JUMP_JGT);
+JUMP_CHECK('E', 'Q', JUMP_JEQ);
+JUMP_CHECK('G', 'E', JUMP_JGE);
+JUMP_CHECK('L', 'T', JUMP_JLT);
+JUMP_CHECK('N', 'E', JUMP_JNE);
+JUMP_CHECK('L', 'E', JUMP_JLE);
+JUMP_CHECK('M', 'P', JUMP_JMP);
+
+static SymbolDest get_dest(Memory* memory, Token token) {
+    EXIT_IF_PRINT(token.tag != TOKEN_STR, memory, token.offset);
+    const Key key = memory->symbols[token.body.as_symbol].key;
+    u32       dest = 0;
+    for (u32 i = 0; i < key.len; ++i) {
+        const u32 bit = DESTS[static_cast<u8>(key.chars[i])];
+        if ((bit == 0) || ((dest & bit) != 0)) {
             EXIT_PRINT(memory, token.offset);
         }
+        dest |= bit;
     }
-    switch (dest) {
-    case 0x01: {
-        return DEST_M;
+    return static_cast<SymbolDest>(dest);
+}
+
+static Atom get_atom(Memory* memory, Token token) {
+    switch (token.tag) {
+    case TOKEN_U15: {
+        switch (token.body.as_u15) {
+        case 0: {
+            return ATOM_ZERO;
+        }
+        case 1: {
+            return ATOM_ONE;
+        }
+        default: {
+            return ATOM_INVALID;
+        }
+        }
     }
-    case 0x02: {
-        return DEST_D;
+    case TOKEN_STR: {
+        const Key key = memory->symbols[token.body.as_symbol].key;
+        if (key.len != 1) {
+            return ATOM_INVALID;
+        }
+        switch (key.chars[0]) {
+        case 'D': {
+            return ATOM_D;
+        }
+        case 'A': {
+            return ATOM_A;
+        }
+        case 'M': {
+            return ATOM_M;
+        }
+        default: {
+            return ATOM_INVALID;
+        }
+        }
     }
-    case 0x03: {
-        return DEST_MD;
+    case TOKEN_MINUS: {
+        return ATOM_MINUS;
     }
-    case 0x04: {
-        return DEST_A;
+    case TOKEN_BANG: {
+        return ATOM_BANG;
     }
-    case 0x05: {
-        return DEST_AM;
+    case TOKEN_PLUS: {
+        return ATOM_PLUS;
     }
-    case 0x06: {
-        return DEST_AD;
+    case TOKEN_AMPERS: {
+        return ATOM_AMPERS;
     }
-    case 0x07: {
-        return DEST_AMD;
+    case TOKEN_PIPE: {
+        return ATOM_PIPE;
     }
+    case TOKEN_LPAREN:
+    case TOKEN_RPAREN:
+    case TOKEN_AT:
+    case TOKEN_EQUALS:
+    case TOKEN_SCOLON:
+    case TOKEN_EOL:
+    case TOKEN_EOF:
     default: {
-        EXIT();
+        return ATOM_NONE;
     }
     }
 }
 
-static SymbolComp get_comp(Memory* memory, u32* i) {
-    const Token left = get_token(memory, *i);
-    switch (left.tag) {
-    case TOKEN_U15: {
-        ++(*i);
-        if (left.body.as_u15 == 0) {
-            return COMP_ZERO;
-        }
-        if (left.body.as_u15 == 1) {
-            return COMP_ONE;
+static SymbolComp get_comp(Memory* memory) {
+    const u64 offset = peek_token(memory, 0).offset;
+    u32       key = 0;
+    for (u32 j = 0;; ++j) {
+        const Atom atom = get_atom(memory, peek_token(memory, 0));
+        if (atom == ATOM_NONE) {
+            break;
         }
-        break;
+        EXIT_IF_PRINT(CAP_ATOMS <= j, memory, offset);
+        key |= static_cast<u32>(atom) << (j * ATOM_BITS);
+        next_token(memory);
     }
-    case TOKEN_MINUS: {
-        const Token token = get_token(memory, ++(*i));
-        ++(*i);
-        if ((token.tag == TOKEN_U15) && (token.body.as_u15 == 1)) {
-            return COMP_NEGATIVE_ONE;
-        }
-        if (token.tag == TOKEN_STR) {
-            if (token.body.as_string == TO_STR("D")) {
-                return COMP_NEGATIVE_D;
-            }
-            if (token.body.as_string == TO_STR("A")) {
-                return COMP_NEGATIVE_A;
-            }
-            if (token.body.as_string == TO_STR("M")) {
-                return COMP_NEGATIVE_M;
-            }
+    const u8 comp = COMPS[key];
+    EXIT_IF_PRINT(comp == COMP_INVALID, memory, offset);
+    return static_cast<SymbolComp>(comp);
+}
+
+static SymbolJump get_jump(Memory* memory, Token token) {
+    if (token.tag != TOKEN_STR) {
+        EXIT_PRINT(memory, token.offset);
+    }
+    const Key key = memory->symbols[token.body.as_symbol].key;
+    if (key.len == 3) {
+        const char* chars = key.chars;
+        const u32   jump = JUMPS[JUMP_HASH(chars[1], chars[2])];
+        if ((jump >> 8u) == JUMP_KEY(chars[0], chars[1], chars[2])) {
+            return static_cast<SymbolJump>(jump & 0xFFu);
         }
-        break;
     }
-    case TOKEN_BANG: {
-        const Token token = get_token(memory, ++(*i));
-        ++(*i);
-        if (token.tag == TOKEN_STR) {
-            if (token.body.as_string == TO_STR("D")) {
-                return COMP_NOT_D;
-            }
-            if (token.body.as_string == TO_STR("A")) {
-                return COMP_NOT_A;
-            }
-            if (token.body.as_string == TO_STR("M")) {
-                return COMP_NOT_M;
+    EXIT_PRINT(memory, token.offset);
+}
+
+// NOTE: Instructions end at the first token that cannot continue them, and
+// `TOKEN_EOL` can continue none of them, so a C-instruction never reaches
+// past its own line and is decoded without backtracking.
+static void parse_compute(Memory* memory) {
+    InstCompute compute = {COMP_ZERO, DEST_NULL, JUMP_NULL};
+    if (peek_token(memory, 1).tag == TOKEN_EQUALS) {
+        compute.dest = get_dest(memory, next_token(memory));
+        next_token(memory);
+    }
+    compute.comp = get_comp(memory);
+    if (peek_token(memory, 0).tag == TOKEN_SCOLON) {
+        next_token(memory);
+        compute.jump = get_jump(memory, next_token(memory));
+    }
+    *alloc_inst(memory) =
+        get_compute(compute.comp, compute.dest, compute.jump);
+}
+
+static void parse_label(Memory* memory) {
+    {
+        const Token token = next_token(memory);
+        if (token.tag != TOKEN_STR) {
+            EXIT_PRINT(memory, token.offset);
+        }
+        // NOTE: Predefined symbols always win over labels of the same name.
+        Symbol* symbol = &memory->symbols[token.body.as_symbol];
+        if (symbol->tag != SYMBOL_PREDEF) {
+            if (symbol->tag != SYMBOL_LABEL) {
+                ++memory->len_labels;
             }
+            symbol->tag = SYMBOL_LABEL;
+            symbol->address = static_cast<u16>(memory->len_insts);
         }
-        break;
     }
-    case TOKEN_STR: {
-        if (*i == (memory->len_tokens - 1)) {
-            ++(*i);
-            if (left.body.as_string == TO_STR("D")) {
-                return COMP_D;
-            }
-            if (left.body.as_string == TO_STR("A")) {
-                return COMP_A;
-            }
-            if (left.body.as_string == TO_STR("M")) {
-                return COMP_M;
-            }
-        } else {
-            const Token op = get_token(memory, ++(*i));
-            const Token right = get_token(memory, ++(*i));
-            ++(*i);
-            if ((op.tag == TOKEN_PLUS) && (right.tag == TOKEN_U15) &&
-                (right.body.as_u15 == 1))
-            {
-                if (left.body.as_string == TO_STR("D")) {
-                    return COMP_D_PLUS_1;
-                }
-                if (left.body.as_string == TO_STR("A")) {
-                    return COMP_A_PLUS_1;
-                }
-                if (left.body.as_string == TO_STR("M")) {
-                    return COMP_M_PLUS_1;
-                }
-            }
-            if ((op.tag == TOKEN_MINUS) && (right.tag == TOKEN_U15) &&
-                (right.body.as_u15 == 1))
-            {
-                if (left.body.as_string == TO_STR("D")) {
-                    return COMP_D_MINUS_1;
-                }
-                if (left.body.as_string == TO_STR("A")) {
-                    return COMP_A_MINUS_1;
-                }
-                if (left.body.as_string == TO_STR("M")) {
-                    return COMP_M_MINUS_1;
-                }
-            }
-            if ((op.tag == TOKEN_PLUS) && (right.tag == TOKEN_STR)) {
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("A")))
-                {
-                    return COMP_D_PLUS_A;
-                }
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("M")))
-                {
-                    return COMP_D_PLUS_M;
-                }
-            }
-            if ((op.tag == TOKEN_MINUS) && (right.tag == TOKEN_STR)) {
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("A")))
-                {
-                    return COMP_D_MINUS_A;
-                }
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("M")))
-                {
-                    return COMP_D_MINUS_M;
-                }
-                if ((left.body.as_string == TO_STR("A")) &&
-                    (right.body.as_string == TO_STR("D")))
-                {
-                    return COMP_A_MINUS_D;
-                }
-                if ((left.body.as_string == TO_STR("M")) &&
-                    (right.body.as_string == TO_STR("D")))
-                {
-                    return COMP_M_MINUS_D;
-                }
-            }
-            if ((op.tag == TOKEN_AMPERS) && (right.tag == TOKEN_STR)) {
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("A")))
-                {
-                    return COMP_D_AND_A;
-                }
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("M")))
-                {
-                    return COMP_D_AND_M;
-                }
-            }
-            if ((op.tag == TOKEN_PIPE) && (right.tag == TOKEN_STR)) {
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("A")))
-                {
-                    return COMP_D_OR_A;
-                }
-                if ((left.body.as_string == TO_STR("D")) &&
-                    (right.body.as_string == TO_STR("M")))
-                {
-                    return COMP_D_OR_M;
-                }
-            }
-            if (left.tag == TOKEN_STR) {
-                *i -= 2;
-                if (left.body.as_string == TO_STR("D")) {
-                    return COMP_D;
-                }
-                if (left.body.as_string == TO_STR("A")) {
-                    return COMP_A;
-                }
-                if (left.body.as_string == TO_STR("M")) {
-                    return COMP_M;
-                }
-            }
+    {
+        const Token token = next_token(memory);
+        EXIT_IF_PRINT(token.tag != TOKEN_RPAREN, memory, token.offset);
+    }
+}
+
+// NOTE: Lexing and parsing happen in the same pass; tokens are consumed as
+// soon as they are produced and never stored.
+static void parse_insts(Memory* memory) {
+    for (;;) {
+        const Token token = peek_token(memory, 0);
+        memory->lexer.start = token.offset;
+        switch (token.tag) {
+        case TOKEN_AT: {
+            next_token(memory);
+            parse_address(memory);
+            break;
+        }
+        case TOKEN_LPAREN: {
+            next_token(memory);
+            parse_label(memory);
+            break;
+        }
+        case TOKEN_STR:
+        case TOKEN_U15:
+        case TOKEN_MINUS:
+        case TOKEN_BANG: {
+            parse_compute(memory);
+            break;
+        }
+        case TOKEN_EOL: {
+            next_token(memory);
+            break;
+        }
+        case TOKEN_EOF: {
+            return;
+        }
+        case TOKEN_RPAREN:
+        case TOKEN_EQUALS:
+        case TOKEN_SCOLON:
+        case TOKEN_PLUS:
+        case TOKEN_AMPERS:
+        case TOKEN_PIPE:
+        default: {
+            EXIT_PRINT(memory, token.offset);
+        }
+        }
+    }
+}
+
+static void set_stopped(Diagnostic* diagnostic, const char* path) {
+    diagnostic->offset = UINT64_MAX;
+    snprintf(diagnostic->reason,
+             LEN_REASON,
+             "%s: stopped after %u diagnostics\n",
+             path,
+             CAP_DIAGNOSTICS);
+}
+
+// NOTE: One slot past `CAP_DIAGNOSTICS` is kept to say that parsing gave
+// up. A slot is only taken once its position is known: should locating it
+// fail, that failure lands here in turn and is filed, without a position,
+// in its place. Returns whether parsing can go on.
+static bool file_diagnostic(Memory* memory, File* stream, const char* reason) {
+    fflush(stream);
+    const long len = ftell(stream);
+    rewind(stream);
+    EXIT_IF((len < 0) || (LEN_REASON <= len));
+    if (memory->len_diagnostics == CAP_DIAGNOSTICS) {
+        set_stopped(&memory->diagnostics[memory->len_diagnostics++],
+                    memory->path);
+        return false;
+    }
+    Diagnostic diagnostic;
+    diagnostic.offset = UINT64_MAX;
+    memcpy(diagnostic.reason, reason, static_cast<usize>(len));
+    diagnostic.reason[len] = '\0';
+    if (memory->failed) {
+        memory->failed = false;
+        diagnostic.offset = memory->offset_failed;
+        diagnostic.position = locate(memory, diagnostic.offset);
+    }
+    memory->diagnostics[memory->len_diagnostics++] = diagnostic;
+    return diagnostic.offset != UINT64_MAX;
+}
+
+static void restart_lexer(Memory* memory, u32 i) {
+    Lexer* lexer = &memory->lexer;
+    lexer->i = i;
+    lexer->start = memory->offset_chars + i;
+    lexer->last = TOKEN_EOL;
+    lexer->tokens[0] = lex(memory);
+    lexer->tokens[1] = lex(memory);
+}
+
+// NOTE: Lexing starts over on the line after the failure. A failure behind
+// the window was on a line the window has already moved past.
+//
+// The lexer runs a token ahead of the parser, so a bad token can end the
+// parse of the line before it. Once the whole input is at hand, that line
+// is parsed again, up to the failure's line, before moving on.
+static void resync(Memory* memory) {
+    const u64 offset = memory->diagnostics[memory->len_diagnostics - 1].offset;
+    const u64 current = memory->lexer.tokens[0].offset;
+    u32       i = 0;
+    if (memory->offset_chars <= offset) {
+        i = find_newline(memory->chars,
+                         static_cast<u32>(offset - memory->offset_chars),
+                         memory->len_chars);
+        i += (i < memory->len_chars) ? 1 : 0;
+    }
+    if ((memory->file < 0) && !memory->reparsing &&
+        (memory->offset_chars <= current) && (current < offset))
+    {
+        const u32 begin = find_line_start(
+            memory->chars,
+            static_cast<u32>(offset - memory->offset_chars));
+        if ((memory->offset_chars + begin) <= current) {
+            restart_lexer(memory, i);
+            return;
+        }
+        memory->reparsing = true;
+        memory->resume = i;
+        memory->len_chars_resumed = memory->len_chars;
+        memory->len_chars = begin;
+        i = find_line_start(
+            memory->chars,
+            static_cast<u32>(current - memory->offset_chars));
+    }
+    restart_lexer(memory, i);
+}
+
+// NOTE: The end of a line parsed again is where parsing picks up for real.
+static bool resume(Memory* memory) {
+    if (!memory->reparsing) {
+        return false;
+    }
+    memory->reparsing = false;
+    memory->len_chars = memory->len_chars_resumed;
+    restart_lexer(memory, memory->resume);
+    return true;
+}
+
+// NOTE: Every failure while parsing lands back here, by way of `escape`,
+// until the input runs out or a failure has no position to resume after.
+static void recover_insts(Memory* memory, u32 i) {
+    jmp_buf* const outer_escape = escape;
+    File* const    outer_errors = errors;
+    jmp_buf        landing;
+    char           reason[LEN_REASON];
+    File* const    stream = fmemopen(reason, LEN_REASON, "w");
+    EXIT_IF(!stream);
+    memory->diagnostics =
+        alloc<Diagnostic>(&memory->arena, CAP_DIAGNOSTICS + 1);
+    memory->recovering = true;
+    memory->failed = false;
+    memory->reparsing = false;
+    escape = &landing;
+    errors = stream;
+    if (setjmp(landing) == 0) {
+        init_lexer(memory, i);
+        parse_insts(memory);
+        while (resume(memory)) {
+            parse_insts(memory);
         }
+    } else if (file_diagnostic(memory, stream, reason)) {
+        resync(memory);
+        parse_insts(memory);
+        while (resume(memory)) {
+            parse_insts(memory);
+        }
+    } else if (memory->reparsing) {
+        memory->reparsing = false;
+        memory->len_chars = memory->len_chars_resumed;
+    }
+    escape = outer_escape;
+    errors = outer_errors;
+    fclose(stream);
+    memory->recovering = false;
+}
+
+static void set_insts(Memory* memory, u32 i) {
+    memory->len_insts = 0;
+    memory->len_fixups = 0;
+    memory->len_diagnostics = 0;
+    if (memory->recover) {
+        recover_insts(memory, i);
+        return;
+    }
+    init_lexer(memory, i);
+    parse_insts(memory);
+}
+
+static i32 compare_diagnostics(const void* a, const void* b) {
+    const u64 l = reinterpret_cast<const Diagnostic*>(a)->offset;
+    const u64 r = reinterpret_cast<const Diagnostic*>(b)->offset;
+    return (l < r) ? -1 : (r < l) ? 1 : 0;
+}
+
+// NOTE: Prints whatever was filed, in input order, and fails if that was
+// anything at all.
+static void check_diagnostics(Memory* memory) {
+    if (memory->len_diagnostics == 0) {
+        return;
+    }
+    qsort(memory->diagnostics,
+          memory->len_diagnostics,
+          sizeof(Diagnostic),
+          compare_diagnostics);
+    for (u32 i = 0; i < memory->len_diagnostics; ++i) {
+        const Diagnostic* diagnostic = &memory->diagnostics[i];
+        if (diagnostic->offset != UINT64_MAX) {
+            print(ERRORS, memory->path, diagnostic->position);
+        }
+        fputs(diagnostic->reason, ERRORS);
+    }
+    fail();
+}
+
+// NOTE: Anything referenced but never defined is a variable, numbered in
+// order of first reference.
+static void resolve(Memory* memory, Symbol* symbol) {
+    if (symbol->tag == SYMBOL_UNKNOWN) {
+        EXIT_IF((MAX_U15 - OFFSET_VARS) < memory->len_vars);
+        symbol->tag = SYMBOL_VAR;
+        symbol->address = static_cast<u16>(memory->len_vars++) + OFFSET_VARS;
+    }
+}
+
+static void resolve_labels(Memory* memory) {
+    for (u32 i = 0; i < memory->len_fixups; ++i) {
+        const Fixup fixup = memory->fixups[i];
+        Symbol*     symbol = &memory->symbols[fixup.symbol];
+        resolve(memory, symbol);
+        memory->insts[fixup.inst] = symbol->address;
+    }
+}
+
+STATIC_ASSERT(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+
+#define TEXT_DIGIT(x, i) \
+    (static_cast<u64>('0' + (((x) >> (7u - (i))) & 1u)) << (8u * (i)))
+
+static constexpr u64 get_text(u32 x) {
+    return TEXT_DIGIT(x, 0u) | TEXT_DIGIT(x, 1u) | TEXT_DIGIT(x, 2u) |
+           TEXT_DIGIT(x, 3u) | TEXT_DIGIT(x, 4u) | TEXT_DIGIT(x, 5u) |
+           TEXT_DIGIT(x, 6u) | TEXT_DIGIT(x, 7u);
+}
+
+// NOTE: Each entry is a byte spelled out as eight ASCII digits, most
+// significant bit first in memory.
+static constexpr u64 TEXTS[256] = {TABLE_256(get_text, 0u)};
+
+#define TEXT_ZEROS 0x3030303030303030ull
+
+STATIC_ASSERT(TEXTS[0x00] == TEXT_ZEROS);
+STATIC_ASSERT(TEXTS[0x80] == (TEXT_ZEROS | 0x01ull));
+STATIC_ASSERT(TEXTS[0x01] == (TEXT_ZEROS | (0x01ull << 56u)));
+
+static void set_bytes(char* chars, u16 bytes) {
+    const u64 high = TEXTS[bytes >> 8u];
+    const u64 low = TEXTS[bytes & 0xFFu];
+    memcpy(&chars[0], &high, sizeof(u64));
+    memcpy(&chars[8], &low, sizeof(u64));
+    chars[LEN_LINE - 1] = '\n';
+}
+
+static void set_output(Memory* memory, u32 begin, u32 end) {
+    for (u32 i = begin; i < end; ++i) {
+        set_bytes(&memory->output[i * LEN_LINE], memory->insts[i]);
+    }
+}
+
+static void set_slice(void* context, u32, u32 task) {
+    Memory*   memory = reinterpret_cast<Memory*>(context);
+    const u32 begin = task * LEN_SLICE;
+    const u32 end = ((memory->len_insts - begin) < LEN_SLICE)
+                        ? memory->len_insts
+                        : begin + LEN_SLICE;
+    set_output(memory, begin, end);
+}
+
+// NOTE: Every line is exactly `LEN_LINE` bytes, so slices of the ROM render
+// into disjoint stretches of `output` with no coordination.
+static void set_output(Memory* memory, Pool* pool) {
+    const u32 len_slices = (memory->len_insts + (LEN_SLICE - 1)) / LEN_SLICE;
+    memory->len_output = memory->len_insts * LEN_LINE;
+    if (!pool || (pool->len_workers < 2) || (len_slices < 2)) {
+        set_output(memory, 0, memory->len_insts);
+        return;
+    }
+    run(pool, len_slices, set_slice, memory);
+}
+
+static void set_output_be(Memory* memory) {
+    memory->len_output = memory->len_insts * 2;
+    for (u32 i = 0; i < memory->len_insts; ++i) {
+        memory->output[i * 2] = static_cast<char>(memory->insts[i] >> 8u);
+        memory->output[(i * 2) + 1] = static_cast<char>(memory->insts[i]);
+    }
+}
+
+static const char HEX[] = "0123456789ABCDEF";
+
+static u32 set_hex(char* chars, u32 byte) {
+    chars[0] = HEX[(byte >> 4u) & 0xFu];
+    chars[1] = HEX[byte & 0xFu];
+    return 2;
+}
+
+static u32 set_record(char*     chars,
+                      u32       address,
+                      RecordTag tag,
+                      const u8* bytes,
+                      u32       len) {
+    u32 sum = len + (address >> 8u) + (address & 0xFFu) + tag;
+    u32 j = 0;
+    chars[j++] = ':';
+    j += set_hex(&chars[j], len);
+    j += set_hex(&chars[j], address >> 8u);
+    j += set_hex(&chars[j], address);
+    j += set_hex(&chars[j], tag);
+    for (u32 i = 0; i < len; ++i) {
+        sum += bytes[i];
+        j += set_hex(&chars[j], bytes[i]);
+    }
+    j += set_hex(&chars[j], (0x100u - (sum & 0xFFu)) & 0xFFu);
+    chars[j++] = '\n';
+    return j;
+}
+
+// NOTE: Records are byte-addressed, high byte of each word first. The whole
+// ROM spans less than 64 KiB, so no extended address records are needed.
+static void set_output_ihex(Memory* memory) {
+    const u32 len = memory->len_insts * 2;
+    u32       j = 0;
+    for (u32 i = 0; i < len; i += LEN_RECORD) {
+        u8        bytes[LEN_RECORD];
+        const u32 len_bytes = ((len - i) < LEN_RECORD) ? len - i : LEN_RECORD;
+        for (u32 k = 0; k < len_bytes; ++k) {
+            const u16 inst = memory->insts[(i + k) / 2];
+            bytes[k] = static_cast<u8>(((i + k) & 1u) ? inst : inst >> 8u);
+        }
+        j += set_record(&memory->output[j], i, RECORD_DATA, bytes, len_bytes);
+    }
+    j += set_record(&memory->output[j], 0, RECORD_EOF, null, 0);
+    memory->len_output = j;
+}
+
+static bool read_bytes(i32 file, void* bytes, usize len) {
+    for (usize i = 0; i < len;) {
+        const ssize_t n =
+            read(file, &reinterpret_cast<char*>(bytes)[i], len - i);
+        if (n <= 0) {
+            return false;
+        }
+        i += static_cast<usize>(n);
+    }
+    return true;
+}
+
+// NOTE: Short counts are retried, so this is normally a single `write`.
+static bool write_bytes(i32 file, const void* bytes, usize len) {
+    for (usize i = 0; i < len;) {
+        const ssize_t n =
+            write(file, &reinterpret_cast<const char*>(bytes)[i], len - i);
+        if (n <= 0) {
+            return false;
+        }
+        i += static_cast<usize>(n);
+    }
+    return true;
+}
+
+static void write_output(const char* path, const char* bytes, u32 len) {
+    const i32 file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    EXIT_IF(file < 0);
+    EXIT_IF(!write_bytes(file, bytes, len));
+    close(file);
+}
+
+static u32 set_image(Memory*      memory,
+                     Format       format,
+                     Pool*        pool,
+                     const char** bytes) {
+    switch (format) {
+    case FORMAT_HACK: {
+        set_output(memory, pool);
+        break;
+    }
+    case FORMAT_BIN_LE: {
+        // NOTE: The encoded instructions already are the image.
+        *bytes = reinterpret_cast<const char*>(memory->insts);
+        return memory->len_insts * 2;
+    }
+    case FORMAT_BIN_BE: {
+        set_output_be(memory);
+        break;
+    }
+    case FORMAT_IHEX: {
+        set_output_ihex(memory);
         break;
     }
-    case TOKEN_LPAREN:
-    case TOKEN_RPAREN:
-    case TOKEN_AT:
-    case TOKEN_EQUALS:
-    case TOKEN_SCOLON:
-    case TOKEN_PLUS:
-    case TOKEN_AMPERS:
-    case TOKEN_PIPE:
     default: {
+        EXIT();
     }
     }
-    EXIT_PRINT(memory, left.offset);
+    *bytes = memory->output;
+    return memory->len_output;
 }
 
-static SymbolJump get_jump(Memory* memory, u32* i) {
-    const Token token = get_token(memory, (*i)++);
-    if (token.body.as_string == TO_STR("JGT")) {
-        return JUMP_JGT;
+static void emit(Memory* memory, Format format, Pool* pool, const char* path) {
+    const char* bytes;
+    const u32   len = set_image(memory, format, pool, &bytes);
+    write_output(path, bytes, len);
+}
+
+// NOTE: Everything in `Memory` is either fixed-size or carved out of its
+// arena, so one `Memory` can assemble any number of files in turn.
+static void reset(Memory* memory) {
+    reset(&memory->arena);
+    init(&memory->ids, &memory->arena, CAP_SYMBOLS, LOAD_MAPS);
+    memory->symbols = alloc<Symbol>(&memory->arena, CAP_SYMBOLS);
+    memory->cap_symbols = CAP_SYMBOLS;
+    memory->len_symbols = 0;
+    memory->len_labels = 0;
+    memory->len_vars = 0;
+    memory->cap_line_starts = 0;
+    memory->len_diagnostics = 0;
+}
+
+static Memory* alloc_memory() {
+    Memory* memory = reinterpret_cast<Memory*>(alloc(sizeof(Memory)));
+    init(&memory->arena, CAP_ARENA);
+    return memory;
+}
+
+// NOTE: Counters of the lexer and symbol table, which a split file has one
+// of per segment.
+static void add_probes(Stats* stats, const Memory* memory) {
+    stats->len_tokens += memory->lexer.len_tokens;
+    stats->len_lookups += memory->ids.lookups;
+    stats->len_probes += memory->ids.lookups + memory->ids.collisions;
+    if (stats->max_probes < memory->ids.max_probes) {
+        stats->max_probes = memory->ids.max_probes;
+    }
+}
+
+static void add_stats(Stats* stats, const Memory* memory) {
+    ++stats->len_files;
+    stats->len_bytes += memory->offset_chars + memory->len_read;
+    stats->len_insts += memory->len_insts;
+    stats->len_symbols += memory->len_symbols;
+    stats->len_labels += memory->len_labels;
+    stats->len_vars += memory->len_vars;
+    add_probes(stats, memory);
+}
+
+static void add_stats(Stats* stats, const Stats* other) {
+    for (u32 i = 0; i < LEN_PHASES; ++i) {
+        stats->times[i] += other->times[i];
+    }
+    stats->len_files += other->len_files;
+    stats->len_bytes += other->len_bytes;
+    stats->len_tokens += other->len_tokens;
+    stats->len_insts += other->len_insts;
+    stats->len_symbols += other->len_symbols;
+    stats->len_labels += other->len_labels;
+    stats->len_vars += other->len_vars;
+    stats->len_lookups += other->len_lookups;
+    stats->len_probes += other->len_probes;
+    if (stats->max_probes < other->max_probes) {
+        stats->max_probes = other->max_probes;
+    }
+}
+
+static void assemble(Memory*     memory,
+                     Format      format,
+                     const char* input,
+                     const char* output) {
+    Stats* stats = &memory->stats;
+    u64    time = get_time();
+    reset(memory);
+    set_chars_from_file(memory, input);
+    time = lap(stats, PHASE_READ, time);
+    set_insts(memory, 0);
+    check_diagnostics(memory);
+    time = lap(stats, PHASE_PARSE, time);
+    resolve_labels(memory);
+    time = lap(stats, PHASE_RESOLVE, time);
+    emit(memory, format, null, output);
+    lap(stats, PHASE_EMIT, time);
+    add_stats(stats, memory);
+    unset_chars(memory);
+}
+
+// NOTE: A large mapped input is cut at line breaks into segments that are
+// lexed and parsed concurrently, each into its own `Memory` and against its
+// own symbol table. `base` is the segment's first instruction once the
+// instruction counts are summed, and `globals` maps its symbol ids onto the
+// merged table.
+struct Segment {
+    Memory* memory;
+    u32*    globals;
+    u32     begin;
+    u32     end;
+    u32     base;
+};
+
+struct Split {
+    Memory*  memory;
+    Segment* segments;
+    u32      len_segments;
+};
+
+static void parse_segment(void* context, u32, u32 task) {
+    const Split*   split = reinterpret_cast<Split*>(context);
+    const Segment* segment = &split->segments[task];
+    const Memory*  whole = split->memory;
+    Memory*        memory = segment->memory;
+    reset(memory);
+    set_chars(memory, whole->path, whole->chars, whole->len_read);
+    memory->len_chars = segment->end;
+    set_insts(memory, segment->begin);
+}
+
+// NOTE: Segments are merged in input order, so a later definition of a
+// label still overrides an earlier one and variables are still numbered by
+// first reference, exactly as in the serial path.
+static void merge_segments(Split* split) {
+    Memory* memory = split->memory;
+    u32     base = 0;
+    for (u32 i = 0; i < split->len_segments; ++i) {
+        Segment* segment = &split->segments[i];
+        Memory*  local = segment->memory;
+        EXIT_IF((CAP_INSTS - base) < local->len_insts);
+        segment->base = base;
+        base += local->len_insts;
+        segment->globals = alloc<u32>(&local->arena, local->len_symbols);
+        for (u32 j = 0; j < local->len_symbols; ++j) {
+            const Symbol symbol = local->symbols[j];
+            const u32    id = intern(memory, symbol.key);
+            segment->globals[j] = id;
+            if (symbol.tag == SYMBOL_LABEL) {
+                Symbol* global = &memory->symbols[id];
+                if (global->tag != SYMBOL_LABEL) {
+                    ++memory->len_labels;
+                }
+                global->tag = SYMBOL_LABEL;
+                global->address =
+                    static_cast<u16>(symbol.address + segment->base);
+            }
+        }
     }
-    if (token.body.as_string == TO_STR("JEQ")) {
-        return JUMP_JEQ;
+    memory->len_insts = base;
+    for (u32 i = 0; i < split->len_segments; ++i) {
+        const Segment* segment = &split->segments[i];
+        const Memory*  local = segment->memory;
+        for (u32 j = 0; j < local->len_fixups; ++j) {
+            const u32 id = segment->globals[local->fixups[j].symbol];
+            resolve(memory, &memory->symbols[id]);
+        }
     }
-    if (token.body.as_string == TO_STR("JGE")) {
-        return JUMP_JGE;
+}
+
+static void patch_segment(void* context, u32, u32 task) {
+    const Split*   split = reinterpret_cast<Split*>(context);
+    const Segment* segment = &split->segments[task];
+    const Memory*  local = segment->memory;
+    Memory*        memory = split->memory;
+    memcpy(&memory->insts[segment->base],
+           local->insts,
+           sizeof(u16) * local->len_insts);
+    for (u32 i = 0; i < local->len_fixups; ++i) {
+        const Fixup fixup = local->fixups[i];
+        memory->insts[segment->base + fixup.inst] =
+            memory->symbols[segment->globals[fixup.symbol]].address;
     }
-    if (token.body.as_string == TO_STR("JLT")) {
-        return JUMP_JLT;
+}
+
+static void assemble_split(Split* split, Pool* pool) {
+    Memory* memory = split->memory;
+    Stats*  stats = &memory->stats;
+    u64     time = get_time();
+    u32     begin = 0;
+    for (u32 i = 0; i < split->len_segments; ++i) {
+        Segment* segment = &split->segments[i];
+        u32      end = memory->len_chars;
+        if ((i + 1) < split->len_segments) {
+            const u32 cut = static_cast<u32>(
+                (static_cast<u64>(memory->len_chars) * (i + 1)) /
+                split->len_segments);
+            end = find_newline(memory->chars,
+                               (cut < begin) ? begin : cut,
+                               memory->len_chars);
+            end += (end < memory->len_chars) ? 1 : 0;
+        }
+        segment->begin = begin;
+        segment->end = end;
+        begin = end;
     }
-    if (token.body.as_string == TO_STR("JNE")) {
-        return JUMP_JNE;
+    run(pool, split->len_segments, parse_segment, split);
+    // NOTE: `CAP_DIAGNOSTICS` holds for the whole input, as it would have
+    // serially. Segments that gave up leave their last slot to say so, and
+    // one such slot is put back after the earliest diagnostics are kept.
+    u32  len_diagnostics = 0;
+    bool stopped = false;
+    for (u32 i = 0; i < split->len_segments; ++i) {
+        len_diagnostics += split->segments[i].memory->len_diagnostics;
     }
-    if (token.body.as_string == TO_STR("JLE")) {
-        return JUMP_JLE;
+    memory->diagnostics =
+        alloc<Diagnostic>(&memory->arena, len_diagnostics + 1);
+    for (u32 i = 0; i < split->len_segments; ++i) {
+        const Memory* local = split->segments[i].memory;
+        u32           len = local->len_diagnostics;
+        if (len == (CAP_DIAGNOSTICS + 1)) {
+            --len;
+            stopped = true;
+        }
+        memcpy(&memory->diagnostics[memory->len_diagnostics],
+               local->diagnostics,
+               sizeof(Diagnostic) * len);
+        memory->len_diagnostics += len;
     }
-    if (token.body.as_string == TO_STR("JMP")) {
-        return JUMP_JMP;
+    qsort(memory->diagnostics,
+          memory->len_diagnostics,
+          sizeof(Diagnostic),
+          compare_diagnostics);
+    if (CAP_DIAGNOSTICS < memory->len_diagnostics) {
+        memory->len_diagnostics = CAP_DIAGNOSTICS;
+        stopped = true;
+    }
+    if (stopped) {
+        set_stopped(&memory->diagnostics[memory->len_diagnostics++],
+                    memory->path);
+    }
+    check_diagnostics(memory);
+    time = lap(stats, PHASE_PARSE, time);
+    merge_segments(split);
+    time = lap(stats, PHASE_MERGE, time);
+    run(pool, split->len_segments, patch_segment, split);
+    lap(stats, PHASE_RESOLVE, time);
+    for (u32 i = 0; i < split->len_segments; ++i) {
+        add_probes(stats, split->segments[i].memory);
     }
-    EXIT_PRINT(memory, token.offset);
 }
 
-static void parse_compute(Memory* memory, u32* i) {
-    InstCompute compute = {COMP_ZERO, DEST_NULL, JUMP_NULL};
-    for (u32 j = *i; j < memory->len_tokens; ++j) {
-        const Token token = get_token(memory, j);
-        if (token.tag == TOKEN_EQUALS) {
-            EXIT_IF_PRINT(*i == j, memory, token.offset);
-            compute.dest = get_dest(memory, i);
-            EXIT_IF(*i != j);
-            ++(*i);
-            compute.comp = get_comp(memory, i);
-            if (*i == memory->len_tokens) {
-                break;
-            }
-            if (get_token(memory, *i).tag == TOKEN_SCOLON) {
-                ++(*i);
-                compute.jump = get_jump(memory, i);
-            }
-            break;
-        } else if (token.tag == TOKEN_SCOLON) {
-            EXIT_IF_PRINT(*i == j, memory, token.offset);
-            compute.comp = get_comp(memory, i);
-            EXIT_IF(*i != j);
-            ++(*i);
-            compute.jump = get_jump(memory, i);
-            break;
+struct Job {
+    const char* input;
+    const char* output;
+    u64         len;
+};
+
+struct Batch {
+    Job*     jobs;
+    Memory** memories;
+    u32      len_jobs;
+    Format   format;
+};
+
+static i32 compare_jobs(const void* a, const void* b) {
+    const u64 l = reinterpret_cast<const Job*>(a)->len;
+    const u64 r = reinterpret_cast<const Job*>(b)->len;
+    return (l < r) ? 1 : (r < l) ? -1 : 0;
+}
+
+static void assemble_job(void* context, u32 worker, u32 task) {
+    Batch*     batch = reinterpret_cast<Batch*>(context);
+    const Job* job = &batch->jobs[task];
+    assemble(batch->memories[worker], batch->format, job->input, job->output);
+}
+
+static Format parse_format(const char* chars) {
+    if (strcmp(chars, "hack") == 0) {
+        return FORMAT_HACK;
+    }
+    if (strcmp(chars, "bin-le") == 0) {
+        return FORMAT_BIN_LE;
+    }
+    if (strcmp(chars, "bin-be") == 0) {
+        return FORMAT_BIN_BE;
+    }
+    if (strcmp(chars, "ihex") == 0) {
+        return FORMAT_IHEX;
+    }
+    EXIT();
+}
+
+static Report parse_report(const char* chars) {
+    if (strcmp(chars, "none") == 0) {
+        return REPORT_NONE;
+    }
+    if (strcmp(chars, "text") == 0) {
+        return REPORT_TEXT;
+    }
+    if (strcmp(chars, "json") == 0) {
+        return REPORT_JSON;
+    }
+    EXIT();
+}
+
+struct Count {
+    const char* name;
+    u64         value;
+};
+
+// NOTE: Text goes to `stderr` with the rest of the chatter; JSON goes alone
+// to `stdout`, for scripts. `wall` is the whole run, where the phase times
+// of a batch are summed over its workers.
+static void print_stats(const Stats* stats, Report report, u64 wall) {
+    const Count counts[] = {
+        {"files", stats->len_files},
+        {"bytes", stats->len_bytes},
+        {"tokens", stats->len_tokens},
+        {"insts", stats->len_insts},
+        {"symbols", stats->len_symbols},
+        {"labels", stats->len_labels},
+        {"vars", stats->len_vars},
+        {"lookups", stats->len_lookups},
+        {"probes", stats->len_probes},
+        {"max_probes", stats->max_probes},
+    };
+    const u32 len_counts = sizeof(counts) / sizeof(counts[0]);
+    switch (report) {
+    case REPORT_NONE: {
+        break;
+    }
+    case REPORT_TEXT: {
+        for (u32 i = 0; i < LEN_PHASES; ++i) {
+            fprintf(stderr,
+                    "%-10s : %.3f ms\n",
+                    PHASES[i],
+                    static_cast<double>(stats->times[i]) / 1000000.0);
         }
+        fprintf(stderr,
+                "%-10s : %.3f ms\n",
+                "wall",
+                static_cast<double>(wall) / 1000000.0);
+        for (u32 i = 0; i < len_counts; ++i) {
+            fprintf(stderr,
+                    "%-10s : %" PRIu64 "\n",
+                    counts[i].name,
+                    counts[i].value);
+        }
+        fprintf(stderr,
+                "%-10s : %.3f\n"
+                "\n",
+                "per lookup",
+                (stats->len_lookups == 0)
+                    ? 0.0
+                    : static_cast<double>(stats->len_probes) /
+                          static_cast<double>(stats->len_lookups));
+        break;
+    }
+    case REPORT_JSON: {
+        printf("{\"ns\": {");
+        for (u32 i = 0; i < LEN_PHASES; ++i) {
+            printf("\"%s\": %" PRIu64 ", ", PHASES[i], stats->times[i]);
+        }
+        printf("\"wall\": %" PRIu64 "}", wall);
+        for (u32 i = 0; i < len_counts; ++i) {
+            printf(", \"%s\": %" PRIu64, counts[i].name, counts[i].value);
+        }
+        printf("}\n");
+        break;
+    }
+    default: {
+        EXIT();
+    }
     }
-    Inst* inst = alloc_inst(memory);
-    inst->tag = INST_COMPUTE;
-    inst->body.as_compute = compute;
 }
 
-static void parse_label(Memory* memory, u32* i) {
-    {
-        const Token token = get_token(memory, *i);
-        if (token.tag != TOKEN_STR) {
-            EXIT_PRINT(memory, token.offset);
+static u64 parse_u64(const char* chars) {
+    char*                    end;
+    const unsigned long long x = strtoull(chars, &end, 10);
+    EXIT_IF((*chars == '\0') || (*end != '\0') || (UINT64_MAX < x));
+    return static_cast<u64>(x);
+}
+
+static u32 parse_u32(const char* chars) {
+    const u64 x = parse_u64(chars);
+    EXIT_IF(UINT32_MAX < x);
+    return static_cast<u32>(x);
+}
+
+// NOTE: A stop is either an address or the name of a label.
+static u32 parse_until(Memory* memory, const char* chars) {
+    if (IS_DIGIT(chars[0])) {
+        const u32 pc = parse_u32(chars);
+        EXIT_IF(MAX_U15 < pc);
+        return pc;
+    }
+    const u32* id = lookup(
+        &memory->ids,
+        to_key((String){chars, static_cast<u32>(strlen(chars))}));
+    EXIT_IF(!id || (memory->symbols[*id].tag != SYMBOL_LABEL));
+    return memory->symbols[*id].address;
+}
+
+// NOTE: Runs the program just assembled and reports where it stopped, along
+// with the value of every variable. With `compile` set, the program runs
+// under the JIT where there is one.
+static void run_program(Memory*     memory,
+                        u64         len_cycles,
+                        const char* until,
+                        bool        compile,
+                        Report      report) {
+    Emulator* emulator = reinterpret_cast<Emulator*>(alloc(sizeof(Emulator)));
+    Jit*      jit = compile ? alloc_jit() : null;
+    load(emulator, memory->insts, memory->len_insts);
+    const u32    pc = until ? parse_until(memory, until) : CAP_ROM;
+    const u64    start = get_time();
+    const Halt   halt = jit ? run_jit(jit, emulator, len_cycles, pc)
+                            : emulate(emulator, len_cycles, pc);
+    const u64    time = get_time() - start;
+    const u32    len_blocks = jit ? jit->len_blocks : 0;
+    const char*  reason = (halt == HALT_PC) ? "pc" : "cycles";
+    const double rate = static_cast<double>(emulator->cycles) /
+                        (static_cast<double>(time) / 1000.0);
+    switch (report) {
+    case REPORT_NONE: {
+        break;
+    }
+    case REPORT_TEXT: {
+        fprintf(stderr,
+                "%-10s : %" PRIu64 "\n"
+                "%-10s : %s\n"
+                "%-10s : %u\n"
+                "%-10s : %u\n"
+                "%-10s : %u\n"
+                "%-10s : %u\n"
+                "%-10s : %u\n"
+                "%-10s : %.3f ms\n"
+                "%-10s : %.3f M/s\n",
+                "cycles",
+                emulator->cycles,
+                "halt",
+                reason,
+                "pc",
+                emulator->pc,
+                "a",
+                emulator->a,
+                "d",
+                emulator->d,
+                "fused",
+                emulator->len_fused,
+                "blocks",
+                len_blocks,
+                "run",
+                static_cast<double>(time) / 1000000.0,
+                "per second",
+                rate);
+        for (u32 i = 0; i < memory->len_symbols; ++i) {
+            const Symbol* symbol = &memory->symbols[i];
+            if (symbol->tag == SYMBOL_VAR) {
+                fprintf(stderr,
+                        "%-10.*s : %u\n",
+                        symbol->key.len,
+                        symbol->key.chars,
+                        emulator->ram[symbol->address]);
+            }
         }
-        insert(&memory->labels,
-               token.body.as_string,
-               static_cast<u16>(memory->len_insts));
+        fprintf(stderr, "\n");
+        break;
     }
-    {
-        const Token token = get_token(memory, ++(*i));
-        EXIT_IF_PRINT(token.tag != TOKEN_RPAREN, memory, token.offset);
-        ++(*i);
+    case REPORT_JSON: {
+        printf("{\"cycles\": %" PRIu64
+               ", \"ns\": %" PRIu64
+               ", \"halt\": \"%s\", \"pc\": %u, \"a\": %u, \"d\": %u"
+               ", \"fused\": %u, \"blocks\": %u}\n",
+               emulator->cycles,
+               time,
+               reason,
+               emulator->pc,
+               emulator->a,
+               emulator->d,
+               emulator->len_fused,
+               len_blocks);
+        break;
+    }
+    default: {
+        EXIT();
     }
+    }
+    if (jit) {
+        free_jit(jit);
+    }
+    munmap(emulator, sizeof(Emulator));
 }
 
-static void set_insts(Memory* memory) {
-    memory->len_insts = 0;
-    for (u32 i = 0; i < memory->len_tokens;) {
-        const Token token = get_token(memory, i);
-        switch (token.tag) {
-        case TOKEN_AT: {
-            ++i;
-            EXIT_IF_PRINT(memory->len_tokens <= i, memory, token.offset);
-            parse_address(memory, &i);
-            break;
+static char* read_file(Arena* arena, const char* path, u32* len) {
+    const i32 file = open(path, O_RDONLY);
+    EXIT_IF(file < 0);
+    struct stat info;
+    EXIT_IF(fstat(file, &info) < 0);
+    EXIT_IF(CAP_MAPPED < static_cast<usize>(info.st_size));
+    *len = static_cast<u32>(info.st_size);
+    char* chars = alloc<char>(arena, *len + SIMD_PAD);
+    EXIT_IF(!read_bytes(file, chars, *len));
+    close(file);
+    memset(&chars[*len], 0, SIMD_PAD);
+    return chars;
+}
+
+// NOTE: A manifest lists one `input output` pair per line. Its text is
+// split in place, so the paths point straight into it.
+static u32 set_paths_from_manifest(Arena*      arena,
+                                   const char* path,
+                                   char***     paths) {
+    u32   len;
+    char* chars = read_file(arena, path, &len);
+    u32   len_paths = 0;
+    for (usize i = 0; i < len;) {
+        while ((i < len) && IS_BLANK(chars[i])) {
+            chars[i++] = '\0';
         }
-        case TOKEN_LPAREN: {
+        if (i < len) {
+            ++len_paths;
+        }
+        while ((i < len) && !IS_BLANK(chars[i])) {
             ++i;
-            EXIT_IF_PRINT(memory->len_tokens <= i, memory, token.offset);
-            parse_label(memory, &i);
-            break;
         }
-        case TOKEN_STR:
-        case TOKEN_U15: {
-            parse_compute(memory, &i);
-            break;
+    }
+    *paths = alloc<char*>(arena, len_paths);
+    for (usize i = 0, j = 0; i < len; ++i) {
+        if ((chars[i] != '\0') && ((i == 0) || (chars[i - 1] == '\0'))) {
+            (*paths)[j++] = &chars[i];
         }
-        case TOKEN_RPAREN:
-        case TOKEN_EQUALS:
-        case TOKEN_SCOLON:
-        case TOKEN_PLUS:
-        case TOKEN_MINUS:
-        case TOKEN_BANG:
-        case TOKEN_AMPERS:
-        case TOKEN_PIPE:
-        default: {
-            EXIT_PRINT(memory, token.offset);
+    }
+    return len_paths;
+}
+
+#define CAP_NAME   (1u << 12)
+#define CAP_ERRORS (1u << 12)
+#define CAP_QUEUE  16
+
+enum RequestTag {
+    REQUEST_ASSEMBLE = 0,
+    REQUEST_STATS,
+    REQUEST_STOP,
+};
+
+enum ResponseStatus {
+    RESPONSE_OK = 0,
+    RESPONSE_FAILED,
+};
+
+// NOTE: Messages on the daemon's socket are a fixed header followed by its
+// payload, in host byte order. A request carries the name to use in
+// diagnostics and then the source; a response carries either the image or
+// the diagnostics.
+struct Request {
+    u32 tag;
+    u32 format;
+    u32 len_name;
+    u32 len_source;
+};
+
+struct Response {
+    u32 status;
+    u32 len;
+};
+
+// NOTE: Nanoseconds from having read a request to having written its
+// response.
+struct Latency {
+    u64 len_requests;
+    u64 len_failed;
+    u64 total;
+    u64 min;
+    u64 max;
+};
+
+#define CAP_DOCUMENTS 8
+#define LEN_PIECE     (1u << 12)
+
+// NOTE: The daemon keeps the last source it assembled under each name, cut
+// at line breaks into pieces of about `LEN_PIECE` bytes. A piece holds what
+// parsing it produced: its instructions, its fixups into the document's
+// symbol table, and the labels it defines, all relative to its first
+// instruction, `base`.
+struct Label {
+    u32 symbol;
+    u16 address;
+};
+
+struct Piece {
+    u16*   insts;
+    Fixup* fixups;
+    Label* labels;
+    u32    begin;
+    u32    end;
+    u32    base;
+    u32    len_insts;
+    u32    len_fixups;
+    u32    len_labels;
+};
+
+// NOTE: `memory` holds the document's symbols and its last image, both the
+// encoded instructions and their text. Pieces live in `arena` until enough
+// of it is garbage that the document is rebuilt from scratch.
+struct Document {
+    Memory* memory;
+    char*   name;
+    char*   source;
+    Piece*  pieces;
+    Arena   arena;
+    u32     len_source;
+    u32     len_pieces;
+    usize   len_live;
+    u32     len_parsed;
+    u32     len_rendered;
+    bool    valid;
+};
+
+// NOTE: One scratch `Memory` serves every request; it is faulted in up
+// front and only reset in between, so a request never waits on the kernel
+// for pages.
+struct Server {
+    Memory*   memory;
+    char*     name;
+    char*     source;
+    Latency   latency;
+    Document  documents[CAP_DOCUMENTS];
+    Document* document;
+    u32       next_document;
+    char      errors[CAP_ERRORS];
+};
+
+#define CAP_PREFAULT (1ul << 22)
+
+static void prefault(Memory* memory) {
+    memset(memory, 0, sizeof(Memory));
+    init(&memory->arena, CAP_ARENA);
+    memset(memory->arena.bytes, 0, CAP_PREFAULT);
+}
+
+static i32 open_socket(const char* path, struct sockaddr_un* address) {
+    EXIT_IF(sizeof(address->sun_path) <= strlen(path));
+    const i32 file = socket(AF_UNIX, SOCK_STREAM, 0);
+    EXIT_IF(file < 0);
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, path, strlen(path));
+    return file;
+}
+
+static bool respond(i32 client, u32 status, const char* bytes, u32 len) {
+    const Response response = {status, len};
+    return write_bytes(client, &response, sizeof(Response)) &&
+           write_bytes(client, bytes, len);
+}
+
+static Document* get_document(Server* server, const char* name) {
+    for (u32 i = 0; i < CAP_DOCUMENTS; ++i) {
+        Document* document = &server->documents[i];
+        if (document->memory && (strcmp(document->name, name) == 0)) {
+            return document;
         }
+    }
+    Document* document = &server->documents[server->next_document];
+    server->next_document = (server->next_document + 1) % CAP_DOCUMENTS;
+    if (!document->memory) {
+        document->memory = alloc_memory();
+        document->name = reinterpret_cast<char*>(alloc(CAP_NAME));
+        document->source =
+            reinterpret_cast<char*>(alloc(CAP_MAPPED + SIMD_PAD));
+        init(&document->arena, CAP_ARENA);
+    }
+    memcpy(document->name, name, strlen(name) + 1);
+    document->valid = false;
+    return document;
+}
+
+static u32 get_prefix(const char* a, const char* b, u32 len) {
+    u32 i = 0;
+    for (; (i + sizeof(u64)) <= len; i += sizeof(u64)) {
+        u64 x;
+        u64 y;
+        memcpy(&x, &a[i], sizeof(u64));
+        memcpy(&y, &b[i], sizeof(u64));
+        if (x != y) {
+            break;
         }
     }
+    while ((i < len) && (a[i] == b[i])) {
+        ++i;
+    }
+    return i;
 }
 
-static void resolve_labels(Memory* memory) {
-    for (u32 i = 0; i < memory->len_insts; ++i) {
-        Inst* inst = &memory->insts[i];
-        if (inst->tag == INST_UNRESOLVED) {
-            {
-                const u16* address =
-                    lookup(&memory->labels, inst->body.as_string);
-                if (address) {
-                    inst->tag = INST_ADDRESS;
-                    inst->body.as_u15 = *address;
-                    goto next;
-                }
-            }
-            {
-                const u16* address =
-                    lookup(&memory->vars, inst->body.as_string);
-                if (address) {
-                    inst->tag = INST_ADDRESS;
-                    inst->body.as_u15 = *address;
-                    goto next;
-                }
-            }
-            const u16 address =
-                static_cast<u16>(memory->vars.len) + OFFSET_VARS;
-            insert(&memory->vars, inst->body.as_string, address);
-            inst->tag = INST_ADDRESS;
-            inst->body.as_u15 = address;
+// NOTE: `a` and `b` point one past the ends being compared.
+static u32 get_suffix(const char* a, const char* b, u32 len) {
+    u32 i = 0;
+    for (; (i + sizeof(u64)) <= len; i += sizeof(u64)) {
+        u64 x;
+        u64 y;
+        memcpy(&x, a - i - sizeof(u64), sizeof(u64));
+        memcpy(&y, b - i - sizeof(u64), sizeof(u64));
+        if (x != y) {
+            break;
         }
-    next:;
     }
+    while ((i < len) && (*(a - i - 1) == *(b - i - 1))) {
+        ++i;
+    }
+    return i;
 }
 
-static void set_bytes(char* chars, u16 bytes) {
-    memcpy(&chars[0], BYTES[(bytes >> 12u) & 0xFu], 4);
-    memcpy(&chars[4], BYTES[(bytes >> 8u) & 0xFu], 4);
-    memcpy(&chars[8], BYTES[(bytes >> 4u) & 0xFu], 4);
-    memcpy(&chars[12], BYTES[bytes & 0xFu], 4);
-    chars[16] = '\n';
+// NOTE: Parsed against a scratch table like a segment, then carried over
+// onto the document's own symbols.
+static void parse_piece(Memory*   local,
+                        Document* document,
+                        char*     chars,
+                        u32       len,
+                        Piece*    piece) {
+    Memory* memory = document->memory;
+    Arena*  arena = &document->arena;
+    reset(local);
+    set_chars(local, document->name, chars, len);
+    local->len_chars = piece->end;
+    set_insts(local, piece->begin);
+    u32* globals = alloc<u32>(&local->arena, local->len_symbols);
+    u32  len_labels = 0;
+    for (u32 i = 0; i < local->len_symbols; ++i) {
+        globals[i] = intern(memory, local->symbols[i].key);
+        len_labels += (local->symbols[i].tag == SYMBOL_LABEL) ? 1 : 0;
+    }
+    piece->insts = alloc<u16>(arena, local->len_insts);
+    piece->fixups = alloc<Fixup>(arena, local->len_fixups);
+    piece->labels = alloc<Label>(arena, len_labels);
+    piece->len_insts = local->len_insts;
+    piece->len_fixups = local->len_fixups;
+    piece->len_labels = 0;
+    memcpy(piece->insts, local->insts, sizeof(u16) * local->len_insts);
+    for (u32 i = 0; i < local->len_fixups; ++i) {
+        const Fixup fixup = local->fixups[i];
+        piece->fixups[i].symbol = globals[fixup.symbol];
+        piece->fixups[i].inst = fixup.inst;
+    }
+    for (u32 i = 0; i < local->len_symbols; ++i) {
+        const Symbol symbol = local->symbols[i];
+        if (symbol.tag == SYMBOL_LABEL) {
+            Label* label = &piece->labels[piece->len_labels++];
+            label->symbol = globals[i];
+            label->address = symbol.address;
+        }
+    }
 }
 
-static void emit(Memory* memory, const char* path) {
-    const u32 n = memory->len_insts * 17;
-    EXIT_IF(CAP_CHARS <= n);
-    for (u32 i = 0; i < memory->len_insts; ++i) {
-        const Inst inst = memory->insts[i];
-        switch (inst.tag) {
-        case INST_ADDRESS: {
-            set_bytes(&memory->chars[i * 17], inst.body.as_u15);
+// NOTE: An edit leaves some prefix and suffix of the source as it was. The
+// pieces lying wholly within them are kept, and only the lines in between
+// are parsed again. Symbols are then re-resolved from the pieces' labels
+// and fixups, which reads no source text, and only words whose address
+// moved are patched and rendered again. Should anything past parsing fail,
+// the next request rebuilds the document from scratch.
+static void assemble_document(Memory*   local,
+                              Document* document,
+                              char**    chars,
+                              u32       len) {
+    Memory* memory = document->memory;
+    if (((2 * document->len_live) + CAP_CHUNK) < document->arena.len) {
+        document->valid = false;
+    }
+    if (!document->valid) {
+        reset(memory);
+        reset(&document->arena);
+        memory->len_insts = 0;
+        document->len_source = 0;
+        document->len_pieces = 0;
+    }
+    const Piece* old = document->pieces;
+    const u32    len_old = document->len_pieces;
+    const u32    len_before = document->len_source;
+    const u32    len_shared = (len < len_before) ? len : len_before;
+    const u32    prefix = get_prefix(document->source, *chars, len_shared);
+    const u32    suffix = get_suffix(&document->source[len_before],
+                                  &(*chars)[len],
+                                  len_shared - prefix);
+    u32          front = 0;
+    while ((front < len_old) && (old[front].end <= prefix) &&
+           ((old[front].end == len) ||
+            ((*chars)[old[front].end - 1] == '\n')))
+    {
+        ++front;
+    }
+    u32 back = len_old;
+    while (front < back) {
+        const u32 begin = old[back - 1].begin;
+        const u32 moved = (begin + len) - len_before;
+        if ((begin < (len_before - suffix)) ||
+            ((moved != 0) && ((*chars)[moved - 1] != '\n')))
+        {
             break;
         }
-        case INST_COMPUTE: {
-            set_bytes(&memory->chars[i * 17],
-                      static_cast<u16>(
-                          (7u << 13u) |
-                          static_cast<u32>(inst.body.as_compute.comp) << 6u |
-                          static_cast<u32>(inst.body.as_compute.dest) << 3u |
-                          static_cast<u32>(inst.body.as_compute.jump)));
-            break;
+        --back;
+    }
+    const u32 begin = (front == 0) ? 0 : old[front - 1].end;
+    const u32 end =
+        (back == len_old) ? len : (old[back].begin + len) - len_before;
+    Piece* pieces =
+        alloc<Piece>(&document->arena,
+                     front + ((end - begin) / LEN_PIECE) + 1 + len_old - back);
+    u32 len_pieces = 0;
+    for (; len_pieces < front; ++len_pieces) {
+        pieces[len_pieces] = old[len_pieces];
+    }
+    for (u32 i = begin; i < end;) {
+        u32 j = ((end - i) <= LEN_PIECE)
+                    ? end
+                    : find_newline(*chars, i + LEN_PIECE - 1, end);
+        j += (j < end) ? 1 : 0;
+        Piece* piece = &pieces[len_pieces++];
+        piece->begin = i;
+        piece->end = j;
+        parse_piece(local, document, *chars, len, piece);
+        i = j;
+    }
+    const u32 middle = len_pieces;
+    for (u32 i = back; i < len_old; ++i) {
+        Piece* piece = &pieces[len_pieces++];
+        *piece = old[i];
+        piece->begin = (piece->begin + len) - len_before;
+        piece->end = (piece->end + len) - len_before;
+    }
+    const u32 old_back = (back < len_old) ? old[back].base : memory->len_insts;
+    u32       len_insts = 0;
+    usize     len_live = sizeof(Piece) * len_pieces;
+    for (u32 i = 0; i < len_pieces; ++i) {
+        Piece* piece = &pieces[i];
+        EXIT_IF((CAP_INSTS - len_insts) < piece->len_insts);
+        piece->base = len_insts;
+        len_insts += piece->len_insts;
+        len_live += (sizeof(u16) * piece->len_insts) +
+                    (sizeof(Fixup) * piece->len_fixups) +
+                    (sizeof(Label) * piece->len_labels);
+    }
+    const u32 new_back =
+        (middle < len_pieces) ? pieces[middle].base : len_insts;
+    document->valid = false;
+    for (u32 i = 0; i < memory->len_symbols; ++i) {
+        Symbol* symbol = &memory->symbols[i];
+        if (symbol->tag != SYMBOL_PREDEF) {
+            symbol->tag = SYMBOL_UNKNOWN;
         }
-        case INST_UNRESOLVED:
-        default: {
-            EXIT();
+    }
+    memory->len_labels = 0;
+    memory->len_vars = 0;
+    for (u32 i = 0; i < len_pieces; ++i) {
+        const Piece* piece = &pieces[i];
+        for (u32 j = 0; j < piece->len_labels; ++j) {
+            const Label label = piece->labels[j];
+            Symbol*     symbol = &memory->symbols[label.symbol];
+            if (symbol->tag != SYMBOL_LABEL) {
+                ++memory->len_labels;
+            }
+            symbol->tag = SYMBOL_LABEL;
+            symbol->address = static_cast<u16>(label.address + piece->base);
         }
+    }
+    for (u32 i = 0; i < len_pieces; ++i) {
+        const Piece* piece = &pieces[i];
+        for (u32 j = 0; j < piece->len_fixups; ++j) {
+            resolve(memory, &memory->symbols[piece->fixups[j].symbol]);
         }
     }
+    memmove(&memory->insts[new_back],
+            &memory->insts[old_back],
+            sizeof(u16) * (len_insts - new_back));
+    memmove(&memory->output[new_back * LEN_LINE],
+            &memory->output[old_back * LEN_LINE],
+            LEN_LINE * (len_insts - new_back));
+    document->len_rendered = 0;
+    for (u32 i = 0; i < len_pieces; ++i) {
+        const Piece* piece = &pieces[i];
+        if ((front <= i) && (i < middle)) {
+            memcpy(&memory->insts[piece->base],
+                   piece->insts,
+                   sizeof(u16) * piece->len_insts);
+            for (u32 j = 0; j < piece->len_fixups; ++j) {
+                const Fixup fixup = piece->fixups[j];
+                memory->insts[piece->base + fixup.inst] =
+                    memory->symbols[fixup.symbol].address;
+            }
+            set_output(memory, piece->base, piece->base + piece->len_insts);
+            document->len_rendered += piece->len_insts;
+            continue;
+        }
+        for (u32 j = 0; j < piece->len_fixups; ++j) {
+            const Fixup fixup = piece->fixups[j];
+            const u32   k = piece->base + fixup.inst;
+            const u16   address = memory->symbols[fixup.symbol].address;
+            if (memory->insts[k] != address) {
+                memory->insts[k] = address;
+                set_bytes(&memory->output[k * LEN_LINE], address);
+                ++document->len_rendered;
+            }
+        }
+    }
+    memory->len_insts = len_insts;
+    memory->len_output = len_insts * LEN_LINE;
+    document->pieces = pieces;
+    document->len_pieces = len_pieces;
+    document->len_live = len_live;
+    document->len_parsed = end - begin;
+    document->len_source = len;
+    // NOTE: The request's buffer becomes the document's source, and the old
+    // source is left to be overwritten by the next request.
+    char* source = document->source;
+    document->source = *chars;
+    *chars = source;
+    document->valid = true;
+}
+
+static bool serve_assemble(Server* server, i32 client, Request request) {
+    if ((CAP_NAME <= request.len_name) || (CAP_MAPPED < request.len_source) ||
+        (FORMAT_IHEX < request.format) ||
+        !read_bytes(client, server->name, request.len_name) ||
+        !read_bytes(client, server->source, request.len_source))
     {
-        File* file = fopen(path, "wb");
-        EXIT_IF(!file);
-        EXIT_IF(fwrite(memory->chars, sizeof(char), n, file) != n);
-        fclose(file);
+        return false;
+    }
+    const u64 start = get_time();
+    server->name[request.len_name] = '\0';
+    memset(&server->source[request.len_source], 0, SIMD_PAD);
+    Memory*     local = server->memory;
+    const char* bytes;
+    u32         len;
+    u32         status;
+    jmp_buf     landing;
+    File*       stream = fmemopen(server->errors, CAP_ERRORS, "w");
+    EXIT_IF(!stream);
+    escape = &landing;
+    errors = stream;
+    if (setjmp(landing) == 0) {
+        server->document = get_document(server, server->name);
+        Memory* memory = server->document->memory;
+        assemble_document(local,
+                          server->document,
+                          &server->source,
+                          request.len_source);
+        if (request.format == FORMAT_HACK) {
+            bytes = memory->output;
+            len = memory->len_output;
+        } else {
+            // NOTE: Other formats render into scratch, since `output` has to
+            // keep the text for the next edit.
+            memcpy(local->insts,
+                   memory->insts,
+                   sizeof(u16) * memory->len_insts);
+            local->len_insts = memory->len_insts;
+            len = set_image(local,
+                            static_cast<Format>(request.format),
+                            null,
+                            &bytes);
+        }
+        status = RESPONSE_OK;
+    } else {
+        fflush(stream);
+        bytes = server->errors;
+        len = static_cast<u32>(ftell(stream));
+        status = RESPONSE_FAILED;
+    }
+    escape = null;
+    errors = null;
+    fclose(stream);
+    const bool sent = respond(client, status, bytes, len);
+    const u64  elapsed = get_time() - start;
+    Latency*   latency = &server->latency;
+    if ((latency->len_requests == 0) || (elapsed < latency->min)) {
+        latency->min = elapsed;
+    }
+    if (latency->max < elapsed) {
+        latency->max = elapsed;
     }
+    ++latency->len_requests;
+    latency->len_failed += (status != RESPONSE_OK) ? 1 : 0;
+    latency->total += elapsed;
+    const Document* document = server->document;
+    fprintf(stderr,
+            "%s : %s, %u instructions, %u bytes parsed, %u lines rendered, "
+            "%.3f ms\n",
+            server->name,
+            (status == RESPONSE_OK) ? "ok" : "failed",
+            (status == RESPONSE_OK) ? document->memory->len_insts : 0,
+            (status == RESPONSE_OK) ? document->len_parsed : 0,
+            (status == RESPONSE_OK) ? document->len_rendered : 0,
+            static_cast<double>(elapsed) / 1000000.0);
+    return sent;
 }
 
-static void* alloc(usize size) {
-    void* memory = mmap(null,
-                        size,
-                        PROT_READ | PROT_WRITE,
-                        MAP_ANONYMOUS | MAP_PRIVATE,
-                        -1,
-                        0);
-    EXIT_IF(memory == MAP_FAILED);
-    return memory;
+static bool serve_stats(Server* server, i32 client) {
+    const Latency* latency = &server->latency;
+    const i32      len = snprintf(
+        server->errors,
+        CAP_ERRORS,
+        "requests : %" PRIu64 "\n"
+        "failed   : %" PRIu64 "\n"
+        "mean ms  : %.3f\n"
+        "min ms   : %.3f\n"
+        "max ms   : %.3f\n",
+        latency->len_requests,
+        latency->len_failed,
+        (latency->len_requests == 0)
+            ? 0.0
+            : static_cast<double>(latency->total) /
+                  static_cast<double>(latency->len_requests) / 1000000.0,
+        static_cast<double>(latency->min) / 1000000.0,
+        static_cast<double>(latency->max) / 1000000.0);
+    EXIT_IF((len < 0) || (CAP_ERRORS <= static_cast<u32>(len)));
+    return respond(client,
+                   RESPONSE_OK,
+                   server->errors,
+                   static_cast<u32>(len));
+}
+
+// NOTE: Requests on a connection are served in order until the client hangs
+// up, sends something malformed, or asks the daemon to stop.
+static void serve(const char* path) {
+    struct sockaddr_un address;
+    const i32          file = open_socket(path, &address);
+    // NOTE: Only a socket left behind by an earlier daemon is cleared away;
+    // anything else already at `path` makes `bind` fail instead.
+    struct stat info;
+    if ((lstat(path, &info) == 0) && S_ISSOCK(info.st_mode)) {
+        EXIT_IF(unlink(path) != 0);
+    }
+    EXIT_IF(bind(file,
+                 reinterpret_cast<struct sockaddr*>(&address),
+                 sizeof(struct sockaddr_un)) != 0);
+    EXIT_IF(listen(file, CAP_QUEUE) != 0);
+    signal(SIGPIPE, SIG_IGN);
+    Server server;
+    memset(&server.latency, 0, sizeof(Latency));
+    memset(server.documents, 0, sizeof(server.documents));
+    server.document = null;
+    server.next_document = 0;
+    server.memory = reinterpret_cast<Memory*>(alloc(sizeof(Memory)));
+    prefault(server.memory);
+    server.name = reinterpret_cast<char*>(alloc(CAP_NAME));
+    server.source = reinterpret_cast<char*>(alloc(CAP_MAPPED + SIMD_PAD));
+    fprintf(stderr, "Listening on %s\n", path);
+    for (bool stop = false; !stop;) {
+        const i32 client = accept(file, null, null);
+        if (client < 0) {
+            continue;
+        }
+        for (bool open = true; open;) {
+            Request request;
+            if (!read_bytes(client, &request, sizeof(Request))) {
+                break;
+            }
+            switch (request.tag) {
+            case REQUEST_ASSEMBLE: {
+                open = serve_assemble(&server, client, request);
+                break;
+            }
+            case REQUEST_STATS: {
+                open = serve_stats(&server, client);
+                break;
+            }
+            case REQUEST_STOP: {
+                respond(client, RESPONSE_OK, null, 0);
+                open = false;
+                stop = true;
+                break;
+            }
+            default: {
+                open = false;
+            }
+            }
+        }
+        close(client);
+    }
+    close(file);
+    unlink(path);
+}
+
+static void request(Arena*      arena,
+                    const char* path,
+                    RequestTag  tag,
+                    Format      format,
+                    const char* input,
+                    const char* output) {
+    struct sockaddr_un address;
+    const i32          file = open_socket(path, &address);
+    EXIT_IF(connect(file,
+                    reinterpret_cast<struct sockaddr*>(&address),
+                    sizeof(struct sockaddr_un)) != 0);
+    Request header = {tag, format, 0, 0};
+    char*   source = null;
+    if (tag == REQUEST_ASSEMBLE) {
+        source = read_file(arena, input, &header.len_source);
+        header.len_name = static_cast<u32>(strlen(input));
+    }
+    EXIT_IF(!write_bytes(file, &header, sizeof(Request)) ||
+            !write_bytes(file, input, header.len_name) ||
+            !write_bytes(file, source, header.len_source));
+    Response response;
+    EXIT_IF(!read_bytes(file, &response, sizeof(Response)));
+    char* bytes = alloc<char>(arena, response.len);
+    EXIT_IF(!read_bytes(file, bytes, response.len));
+    close(file);
+    if (response.status != RESPONSE_OK) {
+        fwrite(bytes, 1, response.len, stderr);
+        _exit(EXIT_FAILURE);
+    }
+    if (tag == REQUEST_ASSEMBLE) {
+        write_output(output, bytes, response.len);
+    } else {
+        fwrite(bytes, 1, response.len, stdout);
+    }
 }
 
 i32 main(i32 n, char** args) {
+    const u64 start = get_time();
+#ifdef DEBUG
     fprintf(stderr,
             "\n"
-            "sizeof(String)                         : %zu\n"
-            "sizeof(Token)                          : %zu\n"
-            "sizeof(SymbolComp)                     : %zu\n"
-            "sizeof(SymbolPreDef)                   : %zu\n"
-            "sizeof(Inst)                           : %zu\n"
-            "sizeof(Table<String, u16, CAP_LABELS>) : %zu\n"
-            "sizeof(Table<String, u16, CAP_VARS>)   : %zu\n"
-            "sizeof(Memory)                         : %zu\n"
+            "sizeof(String)            : %zu\n"
+            "sizeof(Token)             : %zu\n"
+            "sizeof(Lexer)             : %zu\n"
+            "sizeof(SymbolComp)        : %zu\n"
+            "sizeof(SymbolPreDef)      : %zu\n"
+            "sizeof(Fixup)             : %zu\n"
+            "sizeof(Symbol)            : %zu\n"
+            "sizeof(Memory)            : %zu\n"
             "\n",
             sizeof(String),
             sizeof(Token),
+            sizeof(Lexer),
             sizeof(SymbolComp),
             sizeof(SymbolPreDef),
-            sizeof(Inst),
-            sizeof(Table<String, u16, CAP_LABELS>),
-            sizeof(Table<String, u16, CAP_VARS>),
+            sizeof(Fixup),
+            sizeof(Symbol),
             sizeof(Memory));
-    EXIT_IF(n < 3);
-    {
-        Memory* memory = reinterpret_cast<Memory*>(alloc(sizeof(Memory)));
-        set_chars_from_file(memory, args[1]);
-        set_tokens(memory);
-        set_insts(memory);
-        resolve_labels(memory);
-#ifdef DEBUG
-        fprintf(stderr, "\n");
 #endif
-        fprintf(stderr,
-                "memory->labels.len        : %u\n"
-                "memory->labels.collisions : %u\n"
-                "memory->vars.len          : %u\n"
-                "memory->vars.collisions   : %u\n"
-                "\n",
-                memory->labels.len,
-                memory->labels.collisions,
-                memory->vars.len,
-                memory->vars.collisions);
-        emit(memory, args[2]);
+    Arena arena;
+    init(&arena, CAP_ARENA);
+    char** paths = alloc<char*>(&arena, static_cast<usize>(n));
+    u32    len_paths = 0;
+    u32         len_workers = 0;
+    Format      format = FORMAT_HACK;
+    Report      report = REPORT_TEXT;
+    bool        recover = false;
+    u64         len_cycles = 0;
+    const char* until = null;
+    bool        compile = false;
+    const char* serve_path = null;
+    const char* client_path = null;
+    for (i32 i = 1; i < n; ++i) {
+        if (strcmp(args[i], "--serve") == 0) {
+            EXIT_IF(n <= ++i);
+            serve_path = args[i];
+        } else if (strcmp(args[i], "--client") == 0) {
+            EXIT_IF(n <= ++i);
+            client_path = args[i];
+        } else if (strcmp(args[i], "--format") == 0) {
+            EXIT_IF(n <= ++i);
+            format = parse_format(args[i]);
+        } else if (strcmp(args[i], "--keep-going") == 0) {
+            recover = true;
+        } else if (strcmp(args[i], "--run") == 0) {
+            EXIT_IF(n <= ++i);
+            len_cycles = parse_u64(args[i]);
+            EXIT_IF(len_cycles == 0);
+        } else if (strcmp(args[i], "--until") == 0) {
+            EXIT_IF(n <= ++i);
+            until = args[i];
+        } else if (strcmp(args[i], "--jit") == 0) {
+            compile = true;
+        } else if (strcmp(args[i], "--stats") == 0) {
+            EXIT_IF(n <= ++i);
+            report = parse_report(args[i]);
+        } else if (strcmp(args[i], "--jobs") == 0) {
+            EXIT_IF(n <= ++i);
+            len_workers = parse_u32(args[i]);
+            EXIT_IF(len_workers == 0);
+        } else if (strcmp(args[i], "--manifest") == 0) {
+            EXIT_IF(n <= ++i);
+            char**    manifest;
+            const u32 len_manifest =
+                set_paths_from_manifest(&arena, args[i], &manifest);
+            char** all = alloc<char*>(
+                &arena,
+                len_paths + len_manifest + static_cast<u32>(n - i));
+            memcpy(all, paths, sizeof(char*) * len_paths);
+            memcpy(&all[len_paths], manifest, sizeof(char*) * len_manifest);
+            paths = all;
+            len_paths += len_manifest;
+        } else {
+            paths[len_paths++] = args[i];
+        }
+    }
+    if (serve_path) {
+        EXIT_IF(len_paths != 0);
+        serve(serve_path);
+        return EXIT_SUCCESS;
+    }
+    if (client_path) {
+        if (len_paths == 1) {
+            if (strcmp(paths[0], "stats") == 0) {
+                request(&arena, client_path, REQUEST_STATS, format, "", null);
+            } else {
+                EXIT_IF(strcmp(paths[0], "stop") != 0);
+                request(&arena, client_path, REQUEST_STOP, format, "", null);
+            }
+        } else {
+            EXIT_IF(len_paths != 2);
+            request(&arena,
+                    client_path,
+                    REQUEST_ASSEMBLE,
+                    format,
+                    paths[0],
+                    paths[1]);
+        }
+        return EXIT_SUCCESS;
+    }
+    EXIT_IF((len_paths == 0) || ((len_paths % 2) != 0));
+    // NOTE: `--until` alone runs for as long as it takes.
+    const bool running = (len_cycles != 0) || until;
+    EXIT_IF(running && (len_paths != 2));
+    if (running && (len_cycles == 0)) {
+        len_cycles = UINT64_MAX;
+    }
+    Batch batch;
+    batch.format = format;
+    batch.len_jobs = len_paths / 2;
+    batch.jobs = alloc<Job>(&arena, batch.len_jobs);
+    for (u32 i = 0; i < batch.len_jobs; ++i) {
+        Job* job = &batch.jobs[i];
+        job->input = paths[i * 2];
+        job->output = paths[(i * 2) + 1];
+        struct stat info;
+        job->len = (stat(job->input, &info) == 0)
+                       ? static_cast<u64>(info.st_size)
+                       : 0;
     }
+    if (len_workers == 0) {
+        len_workers = static_cast<u32>(sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    Stats stats;
+    memset(&stats, 0, sizeof(Stats));
+    if (batch.len_jobs == 1) {
+        Memory* memory = alloc_memory();
+        u64     time = get_time();
+        memory->recover = recover;
+        reset(memory);
+        set_chars_from_file(memory, batch.jobs[0].input);
+        time = lap(&memory->stats, PHASE_READ, time);
+        Split split;
+        split.memory = memory;
+        split.len_segments =
+            (memory->file < 0) ? memory->len_chars / LEN_SEGMENT : 0;
+        if (len_workers < split.len_segments) {
+            split.len_segments = len_workers;
+        }
+        Pool pool;
+        init(&pool,
+             &arena,
+             len_workers,
+             len_workers + (CAP_INSTS / LEN_SLICE) + 1);
+        if (split.len_segments < 2) {
+            time = get_time();
+            set_insts(memory, 0);
+            check_diagnostics(memory);
+            time = lap(&memory->stats, PHASE_PARSE, time);
+            resolve_labels(memory);
+            lap(&memory->stats, PHASE_RESOLVE, time);
+        } else {
+            split.segments = alloc<Segment>(&arena, split.len_segments);
+            for (u32 i = 0; i < split.len_segments; ++i) {
+                split.segments[i].memory = alloc_memory();
+                split.segments[i].memory->recover = recover;
+            }
+            assemble_split(&split, &pool);
+        }
+        time = get_time();
+        emit(memory, format, &pool, batch.jobs[0].output);
+        lap(&memory->stats, PHASE_EMIT, time);
+        add_stats(&memory->stats, memory);
+        add_stats(&stats, &memory->stats);
+        if (running) {
+            run_program(memory, len_cycles, until, compile, report);
+        }
+    } else {
+        if (batch.len_jobs < len_workers) {
+            len_workers = batch.len_jobs;
+        }
+        // NOTE: Start the largest files first; work stealing evens out the
+        // rest.
+        qsort(batch.jobs, batch.len_jobs, sizeof(Job), compare_jobs);
+        batch.memories = alloc<Memory*>(&arena, len_workers);
+        for (u32 i = 0; i < len_workers; ++i) {
+            batch.memories[i] = alloc_memory();
+            batch.memories[i]->recover = recover;
+        }
+        Pool pool;
+        init(&pool, &arena, len_workers, batch.len_jobs);
+        run(&pool, batch.len_jobs, assemble_job, &batch);
+        for (u32 i = 0; i < len_workers; ++i) {
+            add_stats(&stats, &batch.memories[i]->stats);
+        }
+    }
+#ifdef DEBUG
+    fprintf(stderr, "\n");
+#endif
+    print_stats(&stats, report, get_time() - start);
     fprintf(stderr, "Done!\n");
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,131 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include "arena.hpp"
+
+#include <pthread.h>
+
+typedef void (*Task)(void* context, u32 worker, u32 task);
+
+// NOTE: Every task is dealt out before the workers start, so a deque only
+// ever shrinks. Its owner takes tasks from the front; a worker whose own
+// deque has run dry steals from the back of someone else's.
+struct Deque {
+    pthread_mutex_t lock;
+    u32*            tasks;
+    u32             front;
+    u32             back;
+};
+
+struct Pool;
+
+struct Worker {
+    Pool*     pool;
+    pthread_t thread;
+    u32       index;
+};
+
+// NOTE: Only `len_running` of the workers take part in a run, one per task
+// at most.
+struct Pool {
+    Deque*  deques;
+    Worker* workers;
+    u32     len_workers;
+    u32     len_running;
+    u32     cap_tasks;
+    Task    task;
+    void*   context;
+};
+
+static void init(Pool* pool, Arena* arena, u32 len_workers, u32 cap_tasks) {
+    EXIT_IF(len_workers == 0);
+    pool->deques = alloc<Deque>(arena, len_workers);
+    pool->workers = alloc<Worker>(arena, len_workers);
+    pool->len_workers = len_workers;
+    pool->len_running = 0;
+    pool->cap_tasks = cap_tasks;
+    for (u32 i = 0; i < len_workers; ++i) {
+        Deque* deque = &pool->deques[i];
+        EXIT_IF(pthread_mutex_init(&deque->lock, null) != 0);
+        deque->tasks = alloc<u32>(arena, (cap_tasks / len_workers) + 1);
+        deque->front = 0;
+        deque->back = 0;
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+}
+
+static bool pop_front(Deque* deque, u32* task) {
+    pthread_mutex_lock(&deque->lock);
+    const bool found = deque->front < deque->back;
+    if (found) {
+        *task = deque->tasks[deque->front++];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool pop_back(Deque* deque, u32* task) {
+    pthread_mutex_lock(&deque->lock);
+    const bool found = deque->front < deque->back;
+    if (found) {
+        *task = deque->tasks[--deque->back];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static void* work(void* argument) {
+    Worker* worker = reinterpret_cast<Worker*>(argument);
+    Pool*   pool = worker->pool;
+    for (;;) {
+        u32 task;
+        if (!pop_front(&pool->deques[worker->index], &task)) {
+            bool found = false;
+            for (u32 i = 1; (i < pool->len_running) && !found; ++i) {
+                found = pop_back(
+                    &pool->deques[(worker->index + i) % pool->len_running],
+                    &task);
+            }
+            if (!found) {
+                return null;
+            }
+        }
+        pool->task(pool->context, worker->index, task);
+    }
+}
+
+// NOTE: Tasks are dealt round-robin in index order, so callers that number
+// their heaviest tasks first get them started first. The calling thread
+// works as worker 0, and no more threads are started than there are tasks
+// for.
+static void run(Pool* pool, u32 len_tasks, Task task, void* context) {
+    EXIT_IF(pool->cap_tasks < len_tasks);
+    pool->len_running =
+        (len_tasks < pool->len_workers) ? len_tasks : pool->len_workers;
+    if (pool->len_running == 0) {
+        return;
+    }
+    for (u32 i = 0; i < pool->len_running; ++i) {
+        pool->deques[i].front = 0;
+        pool->deques[i].back = 0;
+    }
+    for (u32 i = 0; i < len_tasks; ++i) {
+        Deque* deque = &pool->deques[i % pool->len_running];
+        deque->tasks[deque->back++] = i;
+    }
+    pool->task = task;
+    pool->context = context;
+    for (u32 i = 1; i < pool->len_running; ++i) {
+        EXIT_IF(pthread_create(&pool->workers[i].thread,
+                               null,
+                               work,
+                               &pool->workers[i]) != 0);
+    }
+    work(&pool->workers[0]);
+    for (u32 i = 1; i < pool->len_running; ++i) {
+        EXIT_IF(pthread_join(pool->workers[i].thread, null) != 0);
+    }
+}
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef __PRELUDE_H__
 #define __PRELUDE_H__
 
+#include <inttypes.h>
+#include <setjmp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,8 +11,10 @@
 typedef uint8_t  u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
+typedef uint64_t u64;
 typedef size_t   usize;
 
+typedef int16_t i16;
 typedef int32_t i32;
 
 typedef FILE File;
@@ -26,16 +30,30 @@ struct Vec2 {
     T y;
 };
 
+// NOTE: Failures end the process unless the thread has pointed `escape` at
+// a `jmp_buf` to land on instead; diagnostics then go to `errors`, if set.
+static thread_local jmp_buf* escape = null;
+static thread_local File*    errors = null;
+
+#define ERRORS (errors ? errors : stderr)
+
+[[noreturn]] static void fail() {
+    if (escape) {
+        longjmp(*escape, 1);
+    }
+    _exit(EXIT_FAILURE);
+}
+
 #define EXIT()                                                       \
     {                                                                \
-        fprintf(stderr, "%s:%s:%d\n", __FILE__, __func__, __LINE__); \
-        _exit(EXIT_FAILURE);                                         \
+        fprintf(ERRORS, "%s:%s:%d\n", __FILE__, __func__, __LINE__); \
+        fail();                                                      \
     }
 
 #define EXIT_WITH(x)                                                         \
     {                                                                        \
-        fprintf(stderr, "%s:%s:%d `%s`\n", __FILE__, __func__, __LINE__, x); \
-        _exit(EXIT_FAILURE);                                                 \
+        fprintf(ERRORS, "%s:%s:%d `%s`\n", __FILE__, __func__, __LINE__, x); \
+        fail();                                                              \
     }
 
 #define EXIT_IF(condition)     \
@@ -45,4 +63,23 @@ struct Vec2 {
 
 #define STATIC_ASSERT(condition) static_assert(condition, "!(" #condition ")")
 
+// NOTE: Expand to `f(x), f(x + 1), ..., f(x + (N - 1))`; handy for building
+// lookup tables out of `constexpr` functions.
+#define TABLE_4(f, x) f(x), f((x) + 1u), f((x) + 2u), f((x) + 3u)
+#define TABLE_16(f, x) \
+    TABLE_4(f, x), TABLE_4(f, (x) + 4u), TABLE_4(f, (x) + 8u), \
+        TABLE_4(f, (x) + 12u)
+#define TABLE_64(f, x) \
+    TABLE_16(f, x), TABLE_16(f, (x) + 16u), TABLE_16(f, (x) + 32u), \
+        TABLE_16(f, (x) + 48u)
+#define TABLE_256(f, x) \
+    TABLE_64(f, x), TABLE_64(f, (x) + 64u), TABLE_64(f, (x) + 128u), \
+        TABLE_64(f, (x) + 192u)
+#define TABLE_1024(f, x) \
+    TABLE_256(f, x), TABLE_256(f, (x) + 256u), TABLE_256(f, (x) + 512u), \
+        TABLE_256(f, (x) + 768u)
+#define TABLE_4096(f, x) \
+    TABLE_1024(f, x), TABLE_1024(f, (x) + 1024u), \
+        TABLE_1024(f, (x) + 2048u), TABLE_1024(f, (x) + 3072u)
+
 #endif
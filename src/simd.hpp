@@ -0,0 +1,96 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include "prelude.hpp"
+
+#if defined(__AVX2__)
+
+    #include <immintrin.h>
+
+    #define SIMD_WIDTH 32
+
+typedef __m256i Bytes;
+
+static Bytes load(const char* chars) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chars));
+}
+
+static Bytes splat(char x) {
+    return _mm256_set1_epi8(x);
+}
+
+static Bytes eq(Bytes a, Bytes b) {
+    return _mm256_cmpeq_epi8(a, b);
+}
+
+static Bytes bit_or(Bytes a, Bytes b) {
+    return _mm256_or_si256(a, b);
+}
+
+static Bytes sub(Bytes a, Bytes b) {
+    return _mm256_sub_epi8(a, b);
+}
+
+static Bytes min_u8(Bytes a, Bytes b) {
+    return _mm256_min_epu8(a, b);
+}
+
+static u32 to_mask(Bytes bytes) {
+    return static_cast<u32>(_mm256_movemask_epi8(bytes));
+}
+
+#elif defined(__SSE2__)
+
+    #include <emmintrin.h>
+
+    #define SIMD_WIDTH 16
+
+typedef __m128i Bytes;
+
+static Bytes load(const char* chars) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars));
+}
+
+static Bytes splat(char x) {
+    return _mm_set1_epi8(x);
+}
+
+static Bytes eq(Bytes a, Bytes b) {
+    return _mm_cmpeq_epi8(a, b);
+}
+
+static Bytes bit_or(Bytes a, Bytes b) {
+    return _mm_or_si128(a, b);
+}
+
+static Bytes sub(Bytes a, Bytes b) {
+    return _mm_sub_epi8(a, b);
+}
+
+static Bytes min_u8(Bytes a, Bytes b) {
+    return _mm_min_epu8(a, b);
+}
+
+static u32 to_mask(Bytes bytes) {
+    return static_cast<u32>(_mm_movemask_epi8(bytes));
+}
+
+#endif
+
+// NOTE: Buffers scanned with `load` keep this many readable bytes past their
+// end, whichever width (if any) is compiled in.
+#define SIMD_PAD 32
+
+#ifdef SIMD_WIDTH
+
+    #define SIMD_ALL static_cast<u32>((1ull << SIMD_WIDTH) - 1ull)
+
+// NOTE: Lanes of `bytes` within `[lo, hi]`, compared as unsigned.
+static Bytes in_range(Bytes bytes, char lo, char hi) {
+    const Bytes offset = sub(bytes, splat(lo));
+    return eq(min_u8(offset, splat(static_cast<char>(hi - lo))), offset);
+}
+
+#endif
+
+#endif